@@ -0,0 +1,43 @@
+#version 150
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+uniform vec3 sunDirection;
+
+// The rock mesh, radius about one
+in  vec3 in_Position;
+in  vec3 in_Normal;
+
+// Per instance: centre and radius, spin axis and angle
+in  vec4 in_Placement;
+in  vec4 in_Spin;
+
+out vec4 ex_Color;
+
+// Rodrigues' rotation about a unit axis
+vec3 rotate(vec3 v, vec3 axis, float angle) {
+    float c = cos(angle);
+    float s = sin(angle);
+    return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1.0 - c);
+}
+
+void main(void) {
+    vec3 world = in_Placement.xyz + in_Placement.w * rotate(in_Position, in_Spin.xyz, in_Spin.w);
+    vec3 normal = rotate(in_Normal, in_Spin.xyz, in_Spin.w);
+    
+    // A little variety between rocks, keyed off the spin axis
+    float tint = fract(sin(dot(in_Spin.xyz, vec3(12.9898, 78.233, 37.719))) * 43758.5453);
+    vec3 albedo = mix(vec3(0.36, 0.33, 0.30), vec3(0.55, 0.50, 0.44), tint);
+    
+    float light = max(dot(normal, sunDirection), 0.0);
+    
+    ex_Color = vec4(albedo * (0.06 + 0.94 * light), 1.0);
+    gl_Position = viewProjectionMatrix * vec4(world, 1.0);
+}
@@ -0,0 +1,40 @@
+#version 150
+// It was expressed that some drivers required this next line to function properly
+precision highp float;
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+// See Bodies.cpp for where these come from
+uniform vec3 bodyCentre;
+uniform float bodyRadius;
+uniform vec4 bodyColour;            // Average of the terrain
+uniform vec3 sunDirection;
+
+in  vec3 ex_WorldPosition;
+
+out vec4 fragColor;
+
+void main(void) {
+    vec3 origin = cameraPosition.xyz - bodyCentre;
+    vec3 dir = normalize(ex_WorldPosition - cameraPosition.xyz);
+    
+    float b = dot(origin, dir);
+    float c = dot(origin, origin) - bodyRadius * bodyRadius;
+    float discriminant = b * b - c;
+    
+    if (discriminant < 0.0) {
+        discard;
+    }
+    
+    vec3 normal = normalize(origin + (-b - sqrt(discriminant)) * dir);
+    float light = 0.1 + 0.9 * max(dot(normal, sunDirection), 0.0);
+    
+    fragColor = vec4(light * bodyColour.rgb, 1.0);
+}
@@ -0,0 +1,33 @@
+#version 150
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+uniform vec3 bodyCentre;
+uniform float bodyRadius;
+
+// Corners of a unit quad
+in  vec3 in_Position;
+
+out vec3 ex_WorldPosition;
+
+void main(void) {
+    // Facing the camera, at the centre, and just big enough to cover the
+    // silhouette (which is wider than the radius seen in perspective)
+    vec3 right = vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+    vec3 up = vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+    
+    float distance = length(bodyCentre - cameraPosition.xyz);
+    float halfSize = bodyRadius * distance / sqrt(max(distance * distance - bodyRadius * bodyRadius, 1.0));
+    
+    vec3 world = bodyCentre + halfSize * (in_Position.x * right + in_Position.y * up);
+    
+    ex_WorldPosition = world;
+    gl_Position = viewProjectionMatrix * vec4(world, 1.0);
+}
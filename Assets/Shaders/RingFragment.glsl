@@ -0,0 +1,47 @@
+#version 150
+// It was expressed that some drivers required this next line to function properly
+precision highp float;
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+// See Rings.cpp for where these come from
+uniform vec3 planetCentre;
+uniform vec3 ringShape;             // Planet radius, inner and outer ring radius
+uniform vec3 ringNormal;
+uniform vec3 sunDirection;
+
+// Colour, and density in alpha, from the inner edge out
+uniform sampler1D ringTexture;
+
+in  vec3 ex_Offset;                 // From the planet centre
+
+out vec4 fragColor;
+
+void main(void) {
+    float t = (length(ex_Offset) - ringShape.y) / (ringShape.z - ringShape.y);
+    if (t < 0.0 || t > 1.0) {
+        discard;
+    }
+    
+    vec4 ring = texture(ringTexture, t);
+    
+    // In the planet's shadow if the ray towards the sun passes within the
+    // planet radius, softened a little for the penumbra
+    float along = dot(ex_Offset, sunDirection);
+    float closest = sqrt(max(dot(ex_Offset, ex_Offset) - along * along, 0.0));
+    float lit = along > 0.0 ? 1.0 : smoothstep(0.98 * ringShape.x, 1.02 * ringShape.x, closest);
+    
+    // From the unlit side we only see light that's made it through
+    vec3 toCamera = cameraPosition.xyz - (planetCentre + ex_Offset);
+    bool sameSide = dot(ringNormal, sunDirection) * dot(ringNormal, toCamera) > 0.0;
+    float side = sameSide ? 1.0 : 0.15 + 0.5 * (1.0 - ring.a);
+    
+    fragColor = vec4((0.04 + lit * side) * ring.rgb, ring.a);
+}
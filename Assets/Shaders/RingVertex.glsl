@@ -0,0 +1,22 @@
+#version 150
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+uniform vec3 planetCentre;
+
+// Annulus around the planet, relative to its centre
+in  vec3 in_Position;
+
+out vec3 ex_Offset;
+
+void main(void) {
+    ex_Offset = in_Position;
+    gl_Position = viewProjectionMatrix * vec4(planetCentre + in_Position, 1.0);
+}
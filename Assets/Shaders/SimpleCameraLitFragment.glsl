@@ -0,0 +1,18 @@
+#version 150
+// It was expressed that some drivers required this next line to function properly
+precision highp float;
+
+// Unit, towards the sun
+uniform vec3 sunDirection;
+
+in  vec4 ex_Color;
+in  vec3 ex_Normal;
+
+out vec4 fragColor;
+
+void main(void) {
+    // Interpolated normals come out a little short, so renormalise
+    float light = max(dot(normalize(ex_Normal), sunDirection), 0.0);
+    
+    fragColor = vec4(ex_Color.rgb * (0.06 + 0.94 * light), ex_Color.a);
+}
@@ -1,5 +1,16 @@
 #version 150
-uniform mat4 mvpmatrix;
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+// Where the mesh's origin sits in the world (e.g. a body's centre)
+uniform vec3 modelOffset;
 
 // in_Position was bound to attribute index 0 and in_Color was bound to attribute index 1
 in  vec3 in_Position;
@@ -12,7 +23,7 @@ void main(void) {
     // Since we are using flat lines, our input only had two points: x and y.
     // Set the Z coordinate to 0 and W coordinate to 1
     
-    gl_Position = mvpmatrix * vec4(in_Position, 1.0);
+    gl_Position = viewProjectionMatrix * vec4(in_Position + modelOffset, 1.0);
 //    gl_Position = vec4(in_Position.x, in_Position.y, 0.0, 1.0);
     
     // GLSL allows shorthand use of vectors too, the following is also valid:
@@ -0,0 +1,108 @@
+#version 150
+// It was expressed that some drivers required this next line to function properly
+precision highp float;
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+// See Atmosphere.cpp for where these come from
+uniform vec3 planetCentre;
+uniform vec4 atmosphereShape;       // Planet radius, top of atmosphere, Rayleigh and Mie scale heights
+uniform vec3 rayleighScattering;
+uniform float mieScattering;
+uniform float mieAnisotropy;
+uniform vec3 sunDirection;
+uniform float sunIntensity;
+
+// Rayleigh and Mie optical depth towards the sun, by cos(sun angle) and sqrt(altitude / thickness)
+uniform sampler2D opticalDepthTable;
+
+in  vec3 ex_WorldPosition;
+
+out vec4 fragColor;
+
+const int numSamples = 8;
+const float pi = 3.14159265;
+
+// Distances along the ray to where it enters and leaves the sphere, both negative if it misses
+vec2 raySphere(vec3 origin, vec3 dir, float radius) {
+    float b = dot(origin, dir);
+    float c = dot(origin, origin) - radius * radius;
+    float discriminant = b * b - c;
+    
+    if (discriminant < 0.0) {
+        return vec2(-1.0);
+    }
+    
+    float root = sqrt(discriminant);
+    return vec2(-b - root, -b + root);
+}
+
+vec2 sunOpticalDepth(float height, float cosSun) {
+    float thickness = atmosphereShape.y - atmosphereShape.x;
+    vec2 uv = vec2(0.5 + 0.5 * cosSun, sqrt(clamp(height / thickness, 0.0, 1.0)));
+    return texture(opticalDepthTable, uv).rg;
+}
+
+void main(void) {
+    float planetRadius = atmosphereShape.x;
+    float atmosphereRadius = atmosphereShape.y;
+    
+    vec3 origin = cameraPosition.xyz - planetCentre;
+    vec3 dir = normalize(ex_WorldPosition - cameraPosition.xyz);
+    
+    vec2 air = raySphere(origin, dir, atmosphereRadius);
+    if (air.y <= 0.0) {
+        discard;
+    }
+    
+    // Stop at the sea; terrain pokes up a little way into the haze
+    float start = max(air.x, 0.0);
+    float end = air.y;
+    
+    vec2 ground = raySphere(origin, dir, planetRadius);
+    if (ground.x > 0.0) {
+        end = min(end, ground.x);
+    }
+    
+    float ds = (end - start) / float(numSamples);
+    vec3 mieExtinction = vec3(1.1 * mieScattering);
+    
+    vec2 viewDepth = vec2(0.0);
+    vec3 rayleigh = vec3(0.0);
+    vec3 mie = vec3(0.0);
+    
+    for (int i = 0; i < numSamples; ++i) {
+        vec3 pt = origin + dir * (start + (float(i) + 0.5) * ds);
+        float r = length(pt);
+        float height = r - planetRadius;
+        
+        vec2 density = exp(-height / atmosphereShape.zw) * ds;
+        viewDepth += density;
+        
+        vec2 depth = viewDepth + sunOpticalDepth(height, dot(pt, sunDirection) / r);
+        vec3 attenuation = exp(-(rayleighScattering * depth.x + mieExtinction * depth.y));
+        
+        rayleigh += density.x * attenuation;
+        mie += density.y * attenuation;
+    }
+    
+    float mu = dot(dir, sunDirection);
+    float g = mieAnisotropy;
+    
+    float rayleighPhase = 3.0 / (16.0 * pi) * (1.0 + mu * mu);
+    float miePhase = 3.0 / (8.0 * pi) * ((1.0 - g * g) * (1.0 + mu * mu)) /
+                     ((2.0 + g * g) * pow(1.0 + g * g - 2.0 * g * mu, 1.5));
+    
+    vec3 light = sunIntensity * (rayleigh * rayleighScattering * rayleighPhase + mie * mieScattering * miePhase);
+    vec3 transmittance = exp(-(rayleighScattering * viewDepth.x + mieExtinction * viewDepth.y));
+    
+    // Simple exposure curve, then premultiplied over the scene
+    fragColor = vec4(1.0 - exp(-light), 1.0 - dot(transmittance, vec3(1.0 / 3.0)));
+}
@@ -0,0 +1,24 @@
+#version 150
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+uniform vec3 planetCentre;
+
+// Proxy sphere around the atmosphere, relative to the planet centre
+in  vec3 in_Position;
+
+out vec3 ex_WorldPosition;
+
+void main(void) {
+    vec3 world = planetCentre + in_Position;
+    
+    ex_WorldPosition = world;
+    gl_Position = viewProjectionMatrix * vec4(world, 1.0);
+}
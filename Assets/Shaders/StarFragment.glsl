@@ -0,0 +1,15 @@
+#version 150
+// It was expressed that some drivers required this next line to function properly
+precision highp float;
+
+in  vec3 ex_Color;
+
+out vec4 fragColor;
+
+void main(void) {
+    // Soft round sprite, blended additively
+    float d = length(2.0 * gl_PointCoord - 1.0);
+    float falloff = clamp(1.0 - d, 0.0, 1.0);
+    
+    fragColor = vec4(falloff * falloff * ex_Color, 1.0);
+}
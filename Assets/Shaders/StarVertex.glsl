@@ -0,0 +1,62 @@
+#version 150
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+// Faintest magnitude being drawn, stars near it fade in rather than pop
+uniform float magnitudeLimit;
+
+// See StarRecord in Stars.cpp
+in  vec2 in_Direction;      // Octahedral
+in  vec2 in_Magnitude;      // Magnitude and B-V colour index, thousandths
+
+out vec3 ex_Color;
+
+// A magnitude 3 star fills one pixel at full brightness; brighter ones spread out
+const float referenceMagnitude = 3.0;
+const float maxPointSize = 4.0;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 dir = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    
+    if (dir.z < 0.0) {
+        dir.xy = (1.0 - abs(dir.yx)) * vec2(dir.x >= 0.0 ? 1.0 : -1.0, dir.y >= 0.0 ? 1.0 : -1.0);
+    }
+    
+    return normalize(dir);
+}
+
+// Blue-white through white and yellow to orange
+vec3 starColour(float colourIndex) {
+    float t = clamp((colourIndex + 0.4) / 2.4, 0.0, 1.0);
+    
+    vec3 hot = vec3(0.65, 0.75, 1.0);
+    vec3 mid = vec3(1.0, 0.96, 0.9);
+    vec3 cool = vec3(1.0, 0.62, 0.38);
+    
+    return t < 0.4 ? mix(hot, mid, t / 0.4) : mix(mid, cool, (t - 0.4) / 0.6);
+}
+
+void main(void) {
+    vec3 dir = octahedralDecode(in_Direction);
+    float magnitude = 0.001 * in_Magnitude.x;
+    
+    // At infinity: rotate only, and pin to the far plane
+    vec4 clip = projectionMatrix * vec4(mat3(viewMatrix) * dir, 0.0);
+    gl_Position = clip.xyww;
+    
+    float flux = pow(10.0, -0.4 * (magnitude - referenceMagnitude));
+    float size = clamp(sqrt(flux), 1.0, maxPointSize);
+    float intensity = min(flux / (size * size), 1.0);
+    
+    intensity *= clamp(2.0 * (magnitudeLimit - magnitude), 0.0, 1.0);
+    
+    gl_PointSize = 2.0 * size;
+    ex_Color = intensity * starColour(0.001 * in_Magnitude.y);
+}
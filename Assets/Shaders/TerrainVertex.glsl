@@ -0,0 +1,67 @@
+#version 150
+
+// Shared per-frame data, see FrameConstants in Shaders.cpp
+layout(std140) uniform FrameConstants {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec4 cameraPosition;
+    float time;
+};
+
+// Where the body's centre sits in the world
+uniform vec3 modelOffset;
+
+// Face being drawn: grid corner and edges on the cube, see TerrainFace
+uniform vec3 faceStart;
+uniform vec3 faceAcross;
+uniform vec3 faceUp;
+
+// Sea level radius, height at in_Height = 1, squares per side, 1 if the grid
+// is tangent warped (see Terrain::setShapeUniform)
+uniform vec4 terrainShape;
+
+uniform sampler1D terrainPalette;
+
+// Packed, see TerrainVertex in Terrain.cpp
+in  float in_Height;
+in  vec2 in_Normal;                 // Octahedral, times 32767
+in  float in_Palette;
+
+out vec4 ex_Color;
+out vec3 ex_Normal;
+
+// warpFaceCoordinate() in CubeSphere.cpp. Left exact on the face edges so
+// neighbouring faces put their shared vertices in the same place.
+float warp(float t) {
+    if (terrainShape.w == 0.0 || t <= 0.0 || t >= 1.0) {
+        return t;
+    }
+    return 0.5 + 0.5 * tan(0.78539816 * (2.0 * t - 1.0));
+}
+
+// octahedralDecode() in Maths.cpp
+vec3 octahedralDecode(vec2 e) {
+    vec3 dir = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    
+    if (dir.z < 0.0) {
+        dir.xy = (1.0 - abs(dir.yx)) * vec2(dir.x >= 0.0 ? 1.0 : -1.0, dir.y >= 0.0 ? 1.0 : -1.0);
+    }
+    
+    return normalize(dir);
+}
+
+void main(void) {
+    // Direction from the vertex's place in the grid
+    int row = int(terrainShape.z) + 1;
+    float u = float(gl_VertexID % row) / terrainShape.z;
+    float v = float(gl_VertexID / row) / terrainShape.z;
+    
+    vec3 dir = normalize(faceStart + warp(u) * faceAcross + warp(v) * faceUp);
+    vec3 position = (terrainShape.x + in_Height * terrainShape.y) * dir;
+    
+    gl_Position = viewProjectionMatrix * vec4(position + modelOffset, 1.0);
+    
+    ex_Color = texelFetch(terrainPalette, int(in_Palette), 0);
+    ex_Normal = octahedralDecode(in_Normal / 32767.0);
+}
@@ -0,0 +1,854 @@
+//
+//  Asteroids.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Asteroid belt: tens of thousands of rocks orbiting the home planet.
+//
+// State is structure-of-arrays, one aligned array per component, so each
+// per-tick kernel is a plain loop over contiguous floats with restrict
+// pointers. That's enough for the compiler to vectorise it (no intrinsics,
+// so it's the same code on x86 and ARM). The arrays are cut into chunks and
+// run across the job system.
+//
+// Every rock feels the planet and moons directly, every tick. The pull of
+// the other rocks comes from a Barnes-Hut tree (Orbits.cpp) and is only
+// refreshed for a slice of the belt each tick, sized to fit a time budget.
+// It's tiny next to the planet's, so holding it for a few seconds is fine,
+// and the cost per tick stays flat however big the belt gets. The tree is
+// rebuilt on the job system once per sweep while the old one is in use.
+//
+// Drawing is instanced. There are three rock meshes (the same lumpy
+// icosphere at three subdivision levels) and one instance list per level,
+// picked by how big each rock is on screen. The lists are built simulation
+// side with the rest of the snapshot and streamed to the GPU every frame.
+
+#include <map>
+
+const char *asteroidVertexShader = "Assets/Shaders/AsteroidVertex.glsl";
+const char *asteroidFragmentShader = "Assets/Shaders/SimpleCameraFragment.glsl";
+
+const ShaderAttribute asteroidShaderAttributes[] = {
+    {0, "in_Position"},
+    {1, "in_Normal"},
+    {3, "in_Placement"},
+    {4, "in_Spin"},
+};
+const int numAsteroidShaderAttributes = sizeof(asteroidShaderAttributes) / sizeof(asteroidShaderAttributes[0]);
+
+// Per instance vertex data
+struct AsteroidInstance {
+    float position[3];
+    float size;             // Radius
+    float axis[3];          // Spin axis, unit
+    float angle;
+};
+
+struct AsteroidSettings {
+    int count;
+    v3 centre;                      // What they start off orbiting
+    float gravitationalParameter;   // G * mass of whatever's at the centre
+    float density;                  // G * density, so mu per unit volume
+    float innerRadius;
+    float outerRadius;
+    float thickness;                // Out of the (equatorial) plane, one standard deviation
+    float minSize;
+    float maxSize;
+    uint32_t seed;
+};
+
+// Rock shape, a radius multiplier for each direction. The same function at
+// every level so they don't change shape when the level does.
+inline float asteroidRockRadius(const v3 &dir) {
+    return 1.0 + 0.25 * noise(1.5 * dir.x, 1.5 * dir.y, 1.5 * dir.z)
+               + 0.08 * noise(4.0 * dir.x + 11.0, 4.0 * dir.y, 4.0 * dir.z);
+}
+
+// The furthest a rock's surface gets from its centre, for a radius of one
+const float asteroidRockBound = 1.35;
+
+// Semi-implicit Euler: a kick from each gravity source, then one drift
+// that adds the held perturbation. It's symplectic, so orbits stay closed
+// rather than spiralling in or out.
+static void kickAsteroids(int begin, int end, float dt, const GravitySource &source,
+                          const float *__restrict px, const float *__restrict py, const float *__restrict pz,
+                          float *__restrict vx, float *__restrict vy, float *__restrict vz) {
+    const float cx = source.position.x, cy = source.position.y, cz = source.position.z;
+    const float muDt = source.mu * dt;
+    const float radius2 = source.radius * source.radius;
+
+    for (int i = begin; i < end; ++i) {
+        float dx = cx - px[i];
+        float dy = cy - py[i];
+        float dz = cz - pz[i];
+
+        // Flying through a moon shouldn't fling anything off to infinity
+        float r2 = dx * dx + dy * dy + dz * dz;
+        r2 = r2 < radius2 ? radius2 : r2;
+        float k = muDt / (r2 * sqrtf(r2));
+
+        vx[i] += k * dx;
+        vy[i] += k * dy;
+        vz[i] += k * dz;
+    }
+}
+
+static void driftAsteroids(int begin, int end, float dt,
+                           const float *__restrict ax, const float *__restrict ay, const float *__restrict az,
+                           float *__restrict px, float *__restrict py, float *__restrict pz,
+                           float *__restrict vx, float *__restrict vy, float *__restrict vz) {
+    for (int i = begin; i < end; ++i) {
+        vx[i] += ax[i] * dt;
+        vy[i] += ay[i] * dt;
+        vz[i] += az[i] * dt;
+
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+        pz[i] += vz[i] * dt;
+    }
+}
+
+// Kept in [0, 2pi) so float precision holds up over a long run. A step
+// never turns a rock a whole turn, so after adding one turn the angle is
+// positive and truncating wraps it (compares would stop it vectorising).
+static void integrateAsteroidSpins(int begin, int end, float dt,
+                                   float *__restrict angle, const float *__restrict spin) {
+    const float twoPi = 2.0 * M_PI;
+
+    for (int i = begin; i < end; ++i) {
+        float a = angle[i] + spin[i] * dt + twoPi;
+        angle[i] = a - twoPi * (float)(int)(a * (1.0f / twoPi));
+    }
+}
+
+// How the rock-on-rock gravity is keeping up, simulation side
+struct AsteroidGravityStats {
+    int treeNodes;
+    double treeBuildTime;           // Seconds, last build
+    int treeBuildTicks;             // Ticks it was spread over, 0 if built on a worker
+    int refreshSlice;               // Rocks per tick, roughly
+    double sweepTime;               // Simulated seconds for a full refresh
+
+    AsteroidGravityStats() {
+        treeNodes = 0;
+        treeBuildTime = 0.0;
+        treeBuildTicks = 0;
+        refreshSlice = 0;
+        sweepTime = 0.0;
+    }
+};
+
+// What gets drawn this frame, one list per level
+struct AsteroidDrawList {
+    static const int numLevels = 3;
+
+    std::vector<AsteroidInstance> levels[numLevels];
+    int dropped;                    // Over the instance budget
+
+    AsteroidDrawList() {
+        dropped = 0;
+    }
+};
+
+struct AsteroidField {
+    static const int numLevels = AsteroidDrawList::numLevels;
+    static const int chunkSize = 8192;          // Rocks per job
+    static const int maxInstances = 65536;      // Drawn per frame, all levels together
+
+    AsteroidSettings settings;
+    int count;
+
+    // One array per component
+    float *positionX, *positionY, *positionZ;
+    float *velocityX, *velocityY, *velocityZ;
+    float *axisX, *axisY, *axisZ;
+    float *angle;
+    float *spin;
+    float *size;
+    float *mu;                      // From the size and density
+    float *perturbX, *perturbY, *perturbZ;      // Pull of the other rocks, refreshed a slice at a time
+    unsigned char *level;           // From the last gather, numLevels if not drawn
+
+    // Smallest on-screen diameter, in pixels, for each level. Anything
+    // smaller than the last isn't drawn at all.
+    float levelPixels[numLevels];
+
+    // Simulation side budget for step(), in seconds, and the part of it
+    // that goes on refreshing perturbations. With no workers building the
+    // tree takes the same again (see startTreeBuild()).
+    double stepBudget;
+    double perturbationBudget;
+
+    // Two trees, one being walked while the other is built
+    GravityTree trees[2];
+    int activeTree;
+    bool treeReady;
+    bool treeBuilding;
+    JobCounter treeBuilt;
+
+    // Groups of the active tree, not rocks
+    int refreshCursor;
+    int refreshSlice;
+    int refreshBegin;
+    double refreshCostPerGroup;      // Seconds, running average
+    AsteroidGravityStats gravityStats;
+
+    // Kernel parameters, for the chunk jobs
+    float stepDt;
+    const GravitySources *stepGravity;
+    v3 cameraPos;
+    v3 viewDirection;
+    float cosViewAngle;
+    float pixelScale;
+
+    // GL side
+    ShaderManager *shaderManager;
+    ShaderHandle shader;
+    int shaderGeneration;           // Of the program sunUniform came from
+    GLint sunUniform;
+    GLuint vao;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    long meshBytes;
+    int firstIndex[numLevels];
+    int numIndices[numLevels];
+
+    StreamBuffer instanceStream;
+
+    // Stats, reset by the caller
+    long instancesDrawn[numLevels];
+    int instancesDropped;
+
+    AsteroidField() {
+        count = 0;
+
+        positionX = positionY = positionZ = NULL;
+        velocityX = velocityY = velocityZ = NULL;
+        axisX = axisY = axisZ = NULL;
+        angle = NULL;
+        spin = NULL;
+        size = NULL;
+        mu = NULL;
+        perturbX = perturbY = perturbZ = NULL;
+        level = NULL;
+
+        levelPixels[0] = 24.0;
+        levelPixels[1] = 6.0;
+        levelPixels[2] = 1.0;
+
+        stepBudget = 0.002;
+        perturbationBudget = 0.0005;
+
+        activeTree = 0;
+        treeReady = false;
+        treeBuilding = false;
+
+        refreshCursor = 0;
+        refreshSlice = 16;
+        refreshBegin = 0;
+        refreshCostPerGroup = 0.0;
+
+        stepDt = 0.0;
+        stepGravity = NULL;
+
+        shaderManager = NULL;
+        shader = InvalidShader;
+        shaderGeneration = -1;
+        sunUniform = -1;
+        vao = 0;
+        vertexBuffer = 0;
+        indexBuffer = 0;
+        meshBytes = 0;
+
+        for (int i = 0; i < numLevels; ++i) {
+            firstIndex[i] = 0;
+            numIndices[i] = 0;
+            instancesDrawn[i] = 0;
+        }
+        instancesDropped = 0;
+    }
+
+    // Cache line aligned, rounded up to a whole number of SIMD lanes
+    static void *allocateLane(int count, size_t elementSize) {
+        void *lane = NULL;
+        size_t bytes = ((count + 15) & ~15) * elementSize;
+
+        if (posix_memalign(&lane, 64, bytes) != 0) {
+            return NULL;
+        }
+        memset(lane, 0, bytes);
+        return lane;
+    }
+
+    // A belt in the centre's equatorial plane: near circular orbits, a
+    // little scatter in and out of the plane, lots of small rocks and a
+    // few big ones.
+    void populate() {
+        uint32_t state = settings.seed * 2654435761u + 1;
+
+        for (int i = 0; i < count; ++i) {
+            // Even per unit area across the belt
+            float inner2 = settings.innerRadius * settings.innerRadius;
+            float outer2 = settings.outerRadius * settings.outerRadius;
+            float radius = sqrt(inner2 + (outer2 - inner2) * randomUnit(state));
+            float theta = 2.0 * M_PI * randomUnit(state);
+
+            float gaussian = sqrt(-2.0 * log(fmax(randomUnit(state), 1.0e-7f))) * cos(2.0 * M_PI * randomUnit(state));
+            float height = settings.thickness * gaussian;
+
+            positionX[i] = settings.centre.x + radius * cos(theta);
+            positionY[i] = settings.centre.y + radius * sin(theta);
+            positionZ[i] = settings.centre.z + height;
+
+            // Within a couple of percent of circular, plus a small tilt
+            float speed = sqrt(settings.gravitationalParameter / radius) * (0.98 + 0.04 * randomUnit(state));
+            velocityX[i] = -speed * sin(theta);
+            velocityY[i] = speed * cos(theta);
+            velocityZ[i] = speed * 0.01 * (2.0 * randomUnit(state) - 1.0);
+
+            v3 axis = octahedralDecode(2.0 * randomUnit(state) - 1.0, 2.0 * randomUnit(state) - 1.0);
+            axisX[i] = axis.x;
+            axisY[i] = axis.y;
+            axisZ[i] = axis.z;
+
+            float u = randomUnit(state);
+            size[i] = settings.minSize * pow(settings.maxSize / settings.minSize, u * u * u * u);
+            mu[i] = settings.density * 4.0 / 3.0 * M_PI * size[i] * size[i] * size[i];
+
+            // Small ones tumble faster
+            angle[i] = 2.0 * M_PI * randomUnit(state);
+            spin[i] = (2.0 * randomUnit(state) - 1.0) * 2.0 / sqrt(size[i]);
+
+            level[i] = numLevels;
+        }
+    }
+
+    // Splits every triangle in four, new vertices pushed out onto the unit sphere
+    static void subdivide(std::vector<v3> &verts, std::vector<ushort> &indices) {
+        std::map<std::pair<int, int>, int> midpoints;
+        std::vector<ushort> result;
+
+        for (size_t t = 0; t < indices.size(); t += 3) {
+            int corners[3] = { indices[t], indices[t + 1], indices[t + 2] };
+            int middles[3];
+
+            for (int e = 0; e < 3; ++e) {
+                int a = corners[e];
+                int b = corners[(e + 1) % 3];
+                std::pair<int, int> key(a < b ? a : b, a < b ? b : a);
+
+                std::map<std::pair<int, int>, int>::iterator found = midpoints.find(key);
+                if (found != midpoints.end()) {
+                    middles[e] = found->second;
+                } else {
+                    middles[e] = (int)verts.size();
+                    verts.push_back(v3normalize(verts[a] + verts[b]));
+                    midpoints[key] = middles[e];
+                }
+            }
+
+            ushort split[12] = {
+                (ushort)corners[0], (ushort)middles[0], (ushort)middles[2],
+                (ushort)corners[1], (ushort)middles[1], (ushort)middles[0],
+                (ushort)corners[2], (ushort)middles[2], (ushort)middles[1],
+                (ushort)middles[0], (ushort)middles[1], (ushort)middles[2],
+            };
+            result.insert(result.end(), split, split + 12);
+        }
+
+        indices.swap(result);
+    }
+
+    // All three levels in one vertex and one index buffer, most detailed
+    // first. Positions and normals interleaved; indices are triangle lists.
+    void buildMeshes() {
+        const float phi = 0.5 * (1.0 + sqrt(5.0));
+        const float corners[12][3] = {
+            {-1, phi, 0}, {1, phi, 0}, {-1, -phi, 0}, {1, -phi, 0},
+            {0, -1, phi}, {0, 1, phi}, {0, -1, -phi}, {0, 1, -phi},
+            {phi, 0, -1}, {phi, 0, 1}, {-phi, 0, -1}, {-phi, 0, 1},
+        };
+        const ushort faces[60] = {
+            0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+            1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+            3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+            4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1,
+        };
+
+        std::vector<v3> sphere[numLevels];
+        std::vector<ushort> triangles[numLevels];
+
+        for (int i = 0; i < 12; ++i) {
+            sphere[numLevels - 1].push_back(v3normalize(v3(corners[i][0], corners[i][1], corners[i][2])));
+        }
+        triangles[numLevels - 1].assign(faces, faces + 60);
+
+        for (int l = numLevels - 2; l >= 0; --l) {
+            sphere[l] = sphere[l + 1];
+            triangles[l] = triangles[l + 1];
+            subdivide(sphere[l], triangles[l]);
+        }
+
+        std::vector<v3> vertexData;         // Position, normal
+        std::vector<ushort> indexData;
+        float acmr[numLevels][2];           // Before and after reordering
+
+        for (int l = 0; l < numLevels; ++l) {
+            int base = (int)vertexData.size() / 2;
+
+            std::vector<v3> positions(sphere[l].size());
+            std::vector<v3> normals(sphere[l].size(), v3(0.0f, 0.0f, 0.0f));
+
+            for (size_t v = 0; v < positions.size(); ++v) {
+                positions[v] = asteroidRockRadius(sphere[l][v]) * sphere[l][v];
+            }
+
+            // Area weighted face normals, and make sure every face winds outwards
+            for (size_t t = 0; t < triangles[l].size(); t += 3) {
+                ushort *tri = &triangles[l][t];
+                v3 normal = v3cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+
+                if (v3dot(normal, positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) < 0.0) {
+                    ushort swap = tri[1];
+                    tri[1] = tri[2];
+                    tri[2] = swap;
+                    normal = -1.0f * normal;
+                }
+
+                for (int k = 0; k < 3; ++k) {
+                    normals[tri[k]] = normals[tri[k]] + normal;
+                }
+            }
+
+            for (size_t v = 0; v < positions.size(); ++v) {
+                vertexData.push_back(positions[v]);
+                vertexData.push_back(v3normalize(normals[v]));
+            }
+
+            // Subdivision leaves the triangles scattered, and every one of
+            // them is drawn for every rock
+            acmr[l][0] = measureVertexCache(&triangles[l][0], (int)triangles[l].size(), (int)positions.size(), false).acmr;
+            tipsifyIndices(&triangles[l][0], (int)triangles[l].size(), (int)positions.size());
+            acmr[l][1] = measureVertexCache(&triangles[l][0], (int)triangles[l].size(), (int)positions.size(), false).acmr;
+
+            firstIndex[l] = (int)indexData.size();
+            numIndices[l] = (int)triangles[l].size();
+
+            for (size_t t = 0; t < triangles[l].size(); ++t) {
+                indexData.push_back((ushort)(base + triangles[l][t]));
+            }
+        }
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        glGenBuffers(1, &vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(v3), &vertexData[0], GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(v3), (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(v3), (void *)sizeof(v3));
+        glEnableVertexAttribArray(1);
+
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(ushort), &indexData[0], GL_STATIC_DRAW);
+
+        // Instance attributes are pointed into the stream buffer at draw time
+        glVertexAttribDivisor(3, 1);
+        glVertexAttribDivisor(4, 1);
+        glEnableVertexAttribArray(3);
+        glEnableVertexAttribArray(4);
+
+        glBindVertexArray(0);
+        CHECK_GL_ERRORS();
+
+        meshBytes = vertexData.size() * sizeof(v3) + indexData.size() * sizeof(ushort);
+        gpuMemory.allocate(GpuMemoryVertex, vertexData.size() * sizeof(v3));
+        gpuMemory.allocate(GpuMemoryIndex, indexData.size() * sizeof(ushort));
+
+        printf("Asteroid meshes: %d, %d and %d triangles, ACMR %.2f, %.2f and %.2f (from %.2f, %.2f and %.2f)\n",
+               numIndices[0] / 3, numIndices[1] / 3, numIndices[2] / 3,
+               acmr[0][1], acmr[1][1], acmr[2][1], acmr[0][0], acmr[1][0], acmr[2][0]);
+    }
+
+    void init(const AsteroidSettings &_settings, ShaderManager *_shaderManager) {
+        settings = _settings;
+        shaderManager = _shaderManager;
+        count = settings.count;
+
+        positionX = (float *)allocateLane(count, sizeof(float));
+        positionY = (float *)allocateLane(count, sizeof(float));
+        positionZ = (float *)allocateLane(count, sizeof(float));
+        velocityX = (float *)allocateLane(count, sizeof(float));
+        velocityY = (float *)allocateLane(count, sizeof(float));
+        velocityZ = (float *)allocateLane(count, sizeof(float));
+        axisX = (float *)allocateLane(count, sizeof(float));
+        axisY = (float *)allocateLane(count, sizeof(float));
+        axisZ = (float *)allocateLane(count, sizeof(float));
+        angle = (float *)allocateLane(count, sizeof(float));
+        spin = (float *)allocateLane(count, sizeof(float));
+        size = (float *)allocateLane(count, sizeof(float));
+        mu = (float *)allocateLane(count, sizeof(float));
+        perturbX = (float *)allocateLane(count, sizeof(float));
+        perturbY = (float *)allocateLane(count, sizeof(float));
+        perturbZ = (float *)allocateLane(count, sizeof(float));
+        level = (unsigned char *)allocateLane(count, sizeof(unsigned char));
+
+        populate();
+
+        // Close passes are softened to about the size of the biggest rocks
+        for (int t = 0; t < 2; ++t) {
+            trees[t].softening = settings.maxSize;
+        }
+
+        buildMeshes();
+        instanceStream.init(GL_ARRAY_BUFFER, maxInstances * sizeof(AsteroidInstance));
+
+        shader = shaderManager->load(asteroidVertexShader, NULL, asteroidFragmentShader,
+                                     asteroidShaderAttributes, numAsteroidShaderAttributes);
+        findUniforms();
+
+        printf("Asteroids: %d, %.1fMB of state\n", count, 17.0 * count * sizeof(float) / 1048576.0);
+    }
+
+    // --- Simulation side ---
+
+    // A chunk at a time, so it stays in cache across the passes
+    static void stepJob(void *data, int begin, int end) {
+        AsteroidField *field = (AsteroidField *)data;
+        const GravitySources &gravity = *field->stepGravity;
+
+        for (int s = 0; s < gravity.count; ++s) {
+            kickAsteroids(begin, end, field->stepDt, gravity.sources[s],
+                          field->positionX, field->positionY, field->positionZ,
+                          field->velocityX, field->velocityY, field->velocityZ);
+        }
+
+        driftAsteroids(begin, end, field->stepDt, field->perturbX, field->perturbY, field->perturbZ,
+                       field->positionX, field->positionY, field->positionZ,
+                       field->velocityX, field->velocityY, field->velocityZ);
+
+        integrateAsteroidSpins(begin, end, field->stepDt, field->angle, field->spin);
+    }
+
+    static void buildTreeJob(void *data) {
+        GravityTree *tree = (GravityTree *)data;
+        tree->build();
+    }
+
+    static void perturbJob(void *data, int begin, int end) {
+        AsteroidField *field = (AsteroidField *)data;
+        const GravityTree &tree = field->trees[field->activeTree];
+
+        static thread_local InteractionList list;
+
+        for (int g = field->refreshBegin + begin; g < field->refreshBegin + end; ++g) {
+            tree.groupAccelerations(tree.groups[g], field->positionX, field->positionY, field->positionZ,
+                                   field->perturbX, field->perturbY, field->perturbZ, list);
+        }
+    }
+
+    // Starts building the spare tree from where the rocks are now. With no
+    // workers to hand it to it's built here instead, a budget's worth each
+    // tick (see continueTreeBuild()), so no one tick pays for all of it.
+    void startTreeBuild() {
+        int spare = activeTree ^ 1;
+        trees[spare].setBodies(positionX, positionY, positionZ, mu, count);
+
+        if (jobs.numWorkers == 1) {
+            trees[spare].beginBuild();
+        } else {
+            jobs.submit(buildTreeJob, &trees[spare], &treeBuilt);
+        }
+        treeBuilding = true;
+    }
+
+    // Returns true once the spare tree is built
+    bool continueTreeBuild() {
+        if (jobs.numWorkers == 1) {
+            GravityTree &spare = trees[activeTree ^ 1];
+            return spare.buildDone() || spare.continueBuild(perturbationBudget);
+        }
+        return treeBuilt.count == 0;
+    }
+
+    // Refreshes the next slice of perturbations, a run of the tree's groups,
+    // and sizes the slice after that to what the budget allows. A finished
+    // tree only takes over at the start of a sweep, so the cursor always
+    // walks one tree's groups.
+    void refreshPerturbations(float dt) {
+        if (treeBuilding && continueTreeBuild() && (refreshCursor == 0 || !treeReady)) {
+            jobs.wait(treeBuilt);
+            treeBuilding = false;
+            activeTree ^= 1;
+            treeReady = true;
+            refreshCursor = 0;
+        }
+
+        if (!treeBuilding && (refreshCursor == 0 || !treeReady)) {
+            startTreeBuild();
+        }
+
+        if (!treeReady) {
+            return;
+        }
+
+        const GravityTree &tree = trees[activeTree];
+        int groups = (int)tree.groups.size();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        int n = groups - refreshCursor < refreshSlice ? groups - refreshCursor : refreshSlice;
+        refreshBegin = refreshCursor;
+        jobs.parallelFor(n, 8, perturbJob, this);
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double costPerGroup = elapsed / (n > 0 ? n : 1);
+        refreshCostPerGroup = refreshCostPerGroup == 0.0 ? costPerGroup : 0.9 * refreshCostPerGroup + 0.1 * costPerGroup;
+
+        refreshSlice = (int)(perturbationBudget / refreshCostPerGroup);
+        if (refreshSlice < 4) {
+            refreshSlice = 4;
+        } else if (refreshSlice > groups) {
+            refreshSlice = groups;
+        }
+
+        refreshCursor += n;
+        if (refreshCursor >= groups) {
+            refreshCursor = 0;
+        }
+
+        gravityStats.treeNodes = (int)tree.nodes.size();
+        gravityStats.treeBuildTime = tree.buildTime;
+        gravityStats.treeBuildTicks = jobs.numWorkers == 1 ? tree.buildSteps : 0;
+        gravityStats.refreshSlice = (int)((double)refreshSlice * count / (groups > 0 ? groups : 1));
+        gravityStats.sweepTime = dt * ceil((double)groups / refreshSlice);
+    }
+
+    // One fixed step, spread across the job system
+    void step(float dt, const GravitySources &gravity) {
+        refreshPerturbations(dt);
+
+        stepDt = dt;
+        stepGravity = &gravity;
+        jobs.parallelFor(count, chunkSize, stepJob, this);
+        stepGravity = NULL;
+    }
+
+    // Level for every rock: in the view cone (allowing for its size) and
+    // big enough on screen, or numLevels if not. Branch free, so it
+    // vectorises like the step.
+    static void classifyJob(void *data, int begin, int end) {
+        AsteroidField *field = (AsteroidField *)data;
+
+        const float *__restrict px = field->positionX;
+        const float *__restrict py = field->positionY;
+        const float *__restrict pz = field->positionZ;
+        const float *__restrict radius = field->size;
+        unsigned char *__restrict level = field->level;
+
+        const float cx = field->cameraPos.x, cy = field->cameraPos.y, cz = field->cameraPos.z;
+        const float fx = field->viewDirection.x, fy = field->viewDirection.y, fz = field->viewDirection.z;
+        const float cosViewAngle = field->cosViewAngle;
+        const float pixelScale = field->pixelScale;
+        const float pixels0 = field->levelPixels[0], pixels1 = field->levelPixels[1], pixels2 = field->levelPixels[2];
+
+        for (int i = begin; i < end; ++i) {
+            float dx = px[i] - cx;
+            float dy = py[i] - cy;
+            float dz = pz[i] - cz;
+
+            float distance = sqrtf(dx * dx + dy * dy + dz * dz) + 1.0e-3f;
+            float along = dx * fx + dy * fy + dz * fz;
+            float bound = asteroidRockBound * radius[i];
+
+            // Conservative for anything smaller than about a radian across
+            int visible = (along >= distance * cosViewAngle - bound) | (distance < 2.0f * bound);
+
+            float pixels = 2.0f * radius[i] * pixelScale / distance;
+            int l = (pixels < pixels0) + (pixels < pixels1) + (pixels < pixels2);
+
+            level[i] = (unsigned char)(l + (numLevels - l) * (1 - visible));
+        }
+    }
+
+    // Fills `list` for the given view. The per rock tests run across the job
+    // system; the copy into the lists is one pass.
+    void gather(const v3 &_cameraPos, const v3 &_viewDirection, float fieldOfView, float aspect, float screenHeight,
+                AsteroidDrawList &list) {
+        float fovRadians = degToRad(fieldOfView);
+
+        cameraPos = _cameraPos;
+        viewDirection = v3normalize(_viewDirection);
+        cosViewAngle = cos(atan(tan(0.5 * fovRadians) * sqrt(1.0 + aspect * aspect)));
+        pixelScale = 0.5 * screenHeight / tan(0.5 * fovRadians);
+
+        jobs.parallelFor(count, chunkSize, classifyJob, this);
+
+        for (int l = 0; l < numLevels; ++l) {
+            list.levels[l].clear();
+        }
+        list.dropped = 0;
+
+        int total = 0;
+
+        // Most rocks aren't drawn, so skip them eight at a time (the lanes
+        // are padded to a multiple of 16 and the padding is never drawn)
+        const uint64_t allHidden = 0x0101010101010101ull * numLevels;
+        for (int i = count; i < ((count + 15) & ~15); ++i) {
+            level[i] = numLevels;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if ((i & 7) == 0) {
+                uint64_t eight;
+                memcpy(&eight, level + i, sizeof(eight));
+                if (eight == allHidden) {
+                    i += 7;
+                    continue;
+                }
+            }
+
+            int l = level[i];
+            if (l >= numLevels) {
+                continue;
+            }
+            if (total >= maxInstances) {
+                list.dropped += 1;
+                continue;
+            }
+
+            AsteroidInstance instance = {
+                { positionX[i], positionY[i], positionZ[i] }, size[i],
+                { axisX[i], axisY[i], axisZ[i] }, angle[i],
+            };
+            list.levels[l].push_back(instance);
+            total += 1;
+        }
+    }
+
+    // --- Render side ---
+
+    // Again only after a hot reload
+    void findUniforms() {
+        if (shaderManager->changedSince(shader, shaderGeneration)) {
+            sunUniform = shaderManager->uniformLocation(shader, "sunDirection");
+        }
+    }
+
+    // Opaque, so with the bodies. Leaves blending off, depth writes on, back
+    // faces culled.
+    void draw(const AsteroidDrawList &list, const v3 &sunDirection) {
+        int total = 0;
+        for (int l = 0; l < numLevels; ++l) {
+            total += (int)list.levels[l].size();
+        }
+
+        instancesDropped += list.dropped;
+
+        if (total == 0) {
+            return;
+        }
+
+        StreamAllocation allocation;
+        if (!instanceStream.allocate(total * sizeof(AsteroidInstance), sizeof(float), allocation)) {
+            instancesDropped += total;
+            return;
+        }
+
+        AsteroidInstance *instances = (AsteroidInstance *)allocation.data;
+        int first[numLevels];
+        int written = 0;
+
+        for (int l = 0; l < numLevels; ++l) {
+            first[l] = written;
+            if (!list.levels[l].empty()) {
+                memcpy(instances + written, &list.levels[l][0], list.levels[l].size() * sizeof(AsteroidInstance));
+                written += (int)list.levels[l].size();
+            }
+        }
+
+        instanceStream.commit(allocation);
+
+        glUseProgram(shaderManager->program(shader));
+        findUniforms();
+        glUniform3f(sunUniform, sunDirection.x, sunDirection.y, sunDirection.z);
+
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_CULL_FACE);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceStream.buffer);
+
+        for (int l = 0; l < numLevels; ++l) {
+            int n = (int)list.levels[l].size();
+            if (n == 0) {
+                continue;
+            }
+
+            const char *base = (const char *)0 + allocation.offset + first[l] * sizeof(AsteroidInstance);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), base);
+            glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), base + offsetof(AsteroidInstance, axis));
+
+            glDrawElementsInstanced(GL_TRIANGLES, numIndices[l], GL_UNSIGNED_SHORT,
+                                    (const GLvoid *)(firstIndex[l] * sizeof(ushort)), n);
+
+            instancesDrawn[l] += n;
+        }
+
+        glBindVertexArray(0);
+        CHECK_GL_ERRORS();
+    }
+
+    // Call after the frame's draws have been submitted
+    void endFrame() {
+        instanceStream.endFrame();
+    }
+
+    void destroy() {
+        if (treeBuilding) {
+            jobs.wait(treeBuilt);
+            treeBuilding = false;
+        }
+
+        instanceStream.destroy();
+
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(1, &vertexBuffer);
+            glDeleteBuffers(1, &indexBuffer);
+            vao = 0;
+            vertexBuffer = 0;
+            indexBuffer = 0;
+
+            long indexBytes = (numIndices[0] + numIndices[1] + numIndices[2]) * sizeof(ushort);
+            gpuMemory.release(GpuMemoryVertex, meshBytes - indexBytes);
+            gpuMemory.release(GpuMemoryIndex, indexBytes);
+        }
+
+        float *lanes[] = { positionX, positionY, positionZ, velocityX, velocityY, velocityZ,
+                           axisX, axisY, axisZ, angle, spin, size, mu, perturbX, perturbY, perturbZ };
+        for (size_t i = 0; i < sizeof(lanes) / sizeof(lanes[0]); ++i) {
+            free(lanes[i]);
+        }
+        free(level);
+
+        positionX = positionY = positionZ = NULL;
+        velocityX = velocityY = velocityZ = NULL;
+        axisX = axisY = axisZ = NULL;
+        angle = NULL;
+        spin = NULL;
+        size = NULL;
+        mu = NULL;
+        perturbX = perturbY = perturbZ = NULL;
+        level = NULL;
+        count = 0;
+    }
+};
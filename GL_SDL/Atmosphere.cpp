@@ -0,0 +1,357 @@
+//
+//  Atmosphere.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Single scattering sky, worked out per pixel.
+//
+// A coarse proxy sphere just outside the top of the atmosphere is drawn with
+// front faces culled, so every pixel the atmosphere could cover gets exactly
+// one fragment whether the camera is inside or out. The fragment shader
+// (SkyFragment.glsl) intersects its view ray with the atmosphere and the
+// planet, marches a few samples along the part in the air and adds up
+// Rayleigh and Mie in-scattering.
+//
+// Optical depth towards the sun only depends on a sample's altitude and the
+// sun's angle, so it comes from a table built here once rather than a second
+// march per sample.
+
+const char *skyVertexShader = "Assets/Shaders/SkyVertex.glsl";
+const char *skyFragmentShader = "Assets/Shaders/SkyFragment.glsl";
+
+struct AtmosphereSettings {
+    float planetRadius;
+    float radius;                   // Top of the atmosphere
+
+    float rayleighScaleHeight;
+    float mieScaleHeight;
+    v3 rayleighScattering;          // Per world unit
+    float mieScattering;
+    float mieAnisotropy;
+
+    v3 sunDirection;                // Unit, towards the sun
+    float sunIntensity;
+};
+
+// Earth's numbers, with its ~60km of atmosphere scaled to fit between the two radii
+AtmosphereSettings earthLikeAtmosphere(float planetRadius, float radius) {
+    float unitsPerKm = (radius - planetRadius) / 60.0;
+
+    AtmosphereSettings settings;
+    settings.planetRadius = planetRadius;
+    settings.radius = radius;
+    settings.rayleighScaleHeight = 8.0 * unitsPerKm;
+    settings.mieScaleHeight = 1.2 * unitsPerKm;
+    settings.rayleighScattering = (1.0f / unitsPerKm) * v3(5.8e-3, 13.5e-3, 33.1e-3);
+    settings.mieScattering = 21.0e-3 / unitsPerKm;
+    settings.mieAnisotropy = 0.76;
+    settings.sunDirection = v3normalize(v3(1.0, 0.5, 0.3));
+    settings.sunIntensity = 20.0;
+
+    return settings;
+}
+
+// Scattering uniforms, looked up again whenever the sky program is rebuilt
+struct SkyUniforms {
+    int generation;
+    GLint planetCentre;
+    GLint atmosphereShape;
+    GLint rayleighScattering;
+    GLint mieScattering;
+    GLint mieAnisotropy;
+    GLint sunDirection;
+    GLint sunIntensity;
+    GLint opticalDepthTable;
+
+    SkyUniforms() {
+        generation = -1;
+    }
+
+    void refresh(ShaderManager *shaders, ShaderHandle shader) {
+        if (!shaders->changedSince(shader, generation)) {
+            return;
+        }
+
+        planetCentre = shaders->uniformLocation(shader, "planetCentre");
+        atmosphereShape = shaders->uniformLocation(shader, "atmosphereShape");
+        rayleighScattering = shaders->uniformLocation(shader, "rayleighScattering");
+        mieScattering = shaders->uniformLocation(shader, "mieScattering");
+        mieAnisotropy = shaders->uniformLocation(shader, "mieAnisotropy");
+        sunDirection = shaders->uniformLocation(shader, "sunDirection");
+        sunIntensity = shaders->uniformLocation(shader, "sunIntensity");
+        opticalDepthTable = shaders->uniformLocation(shader, "opticalDepthTable");
+    }
+};
+
+struct Atmosphere {
+    static const int numFaces = 6;
+    static const int proxySquaresPerSide = 8;
+
+    // Optical depth table, cos(sun angle) across, sqrt(altitude / thickness) up
+    static const int tableWidth = 128;
+    static const int tableHeight = 32;
+    static const int tableSteps = 64;
+
+    AtmosphereSettings settings;
+
+    Mesh proxy[numFaces];
+    GLuint opticalDepthTexture;
+
+    ShaderManager *shaderManager;
+    ShaderHandle shader;
+    SkyUniforms uniforms;
+
+    bool inside;
+
+    // Samples passed, read back a couple of frames late to avoid stalling
+    static const int numQueries = 3;
+    GLuint queries[numQueries];
+    bool queryPending[numQueries];
+    int query;
+    long samplesPassed;
+
+    // Stats, reset by the caller
+    int drawCalls;
+    long trianglesDrawn;
+
+    Atmosphere() {
+        opticalDepthTexture = 0;
+        shaderManager = NULL;
+        shader = InvalidShader;
+        inside = false;
+
+        for (int i = 0; i < numQueries; ++i) {
+            queries[i] = 0;
+            queryPending[i] = false;
+        }
+        query = 0;
+        samplesPassed = 0;
+
+        drawCalls = 0;
+        trianglesDrawn = 0;
+    }
+
+    // Rayleigh and Mie density integrated from `origin` along `dir` to the
+    // top of the atmosphere. Rays that hit the planet get a huge value.
+    void opticalDepth(const v3 &origin, const v3 &dir, float &rayleigh, float &mie) {
+        float b = v3dot(origin, dir);
+        float c = v3dot(origin, origin) - settings.planetRadius * settings.planetRadius;
+        float discriminant = b * b - c;
+
+        if (discriminant > 0.0 && -b - sqrt(discriminant) > 0.0) {
+            rayleigh = 1.0e6;
+            mie = 1.0e6;
+            return;
+        }
+
+        c = v3dot(origin, origin) - settings.radius * settings.radius;
+        float exit = -b + sqrt(fmax(b * b - c, 0.0f));
+
+        float ds = exit / tableSteps;
+
+        rayleigh = 0.0;
+        mie = 0.0;
+
+        for (int i = 0; i < tableSteps; ++i) {
+            v3 pt = origin + ((i + 0.5f) * ds) * dir;
+            float height = v3length(pt) - settings.planetRadius;
+
+            rayleigh += exp(-height / settings.rayleighScaleHeight) * ds;
+            mie += exp(-height / settings.mieScaleHeight) * ds;
+        }
+    }
+
+    void buildOpticalDepthTable() {
+        float *table = (float *)malloc(sizeof(float) * 2 * tableWidth * tableHeight);
+        float thickness = settings.radius - settings.planetRadius;
+
+        for (int j = 0; j < tableHeight; ++j) {
+            float t = (float)j / (tableHeight - 1);
+            float height = t * t * thickness;
+
+            v3 origin(0.0f, settings.planetRadius + height, 0.0f);
+
+            for (int i = 0; i < tableWidth; ++i) {
+                float cosAngle = 2.0 * i / (tableWidth - 1) - 1.0;
+                v3 dir(sqrtf(fmaxf(1.0f - cosAngle * cosAngle, 0.0f)), cosAngle, 0.0f);
+
+                float *texel = table + 2 * (j * tableWidth + i);
+                opticalDepth(origin, dir, texel[0], texel[1]);
+            }
+        }
+
+        glGenTextures(1, &opticalDepthTexture);
+        glBindTexture(GL_TEXTURE_2D, opticalDepthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, tableWidth, tableHeight, 0, GL_RG, GL_FLOAT, table);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        CHECK_GL_ERRORS();
+
+        gpuMemory.allocate(GpuMemoryTexture, sizeof(float) * 2 * tableWidth * tableHeight);
+
+        free(table);
+    }
+
+    void buildProxyFace(int face, v3 startPt, v3 acrossDir, v3 upDir) {
+        int squaresPerSide = proxySquaresPerSide;
+        float scaleFactor = 1.0 / squaresPerSide;
+
+        // Far enough out that the flat triangles stay outside the atmosphere
+        float proxyRadius = 1.03 * settings.radius;
+
+        int numVerts = (squaresPerSide + 1) * (squaresPerSide + 1);
+
+        v3 *verts = (v3 *)malloc(sizeof(v3) * numVerts);
+        v3 *norms = (v3 *)malloc(sizeof(v3) * numVerts);
+        v4 *cols = (v4 *)malloc(sizeof(v4) * numVerts);
+
+        int vertIndex = 0;
+        for (int j = 0; j <= squaresPerSide; ++j) {
+            for (int i = 0; i <= squaresPerSide; ++i) {
+                v3 dir = cubeFaceDirection(startPt, acrossDir, upDir, i * scaleFactor, j * scaleFactor);
+
+                norms[vertIndex] = dir;
+                verts[vertIndex] = proxyRadius * dir;
+                cols[vertIndex] = v4(1.0, 1.0, 1.0, 1.0);
+
+                vertIndex += 1;
+            }
+        }
+
+        int numIndices;
+        ushort *indices = buildGridStripIndices(squaresPerSide, &numIndices);
+
+        proxy[face].setup(numVerts, verts, norms, cols, numIndices, indices);
+
+        free(verts);
+        free(norms);
+        free(cols);
+        free(indices);
+    }
+
+    void build(const AtmosphereSettings &_settings, ShaderManager *_shaderManager) {
+        settings = _settings;
+        shaderManager = _shaderManager;
+
+        buildOpticalDepthTable();
+
+        buildProxyFace(0, v3(1.0, -1.0, 1.0), v3(0.0, 2.0, 0.0), v3(0.0, 0.0, -2.0));
+        buildProxyFace(1, v3(-1.0, 1.0, 1.0), v3(0.0, -2.0, 0.0), v3(0.0, 0.0, -2.0));
+        buildProxyFace(2, v3(1.0, 1.0, 1.0), v3(-2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0));
+        buildProxyFace(3, v3(-1.0, -1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0));
+        buildProxyFace(4, v3(-1.0, 1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, -2.0, 0.0));
+        buildProxyFace(5, v3(-1.0, -1.0, -1.0), v3(2.0, 0.0, 0.0), v3(0.0, 2.0, 0.0));
+
+        shader = shaderManager->load(skyVertexShader, NULL, skyFragmentShader);
+        uniforms.refresh(shaderManager, shader);
+
+        glGenQueries(numQueries, queries);
+        CHECK_GL_ERRORS();
+    }
+
+    void setUniforms(const v3 &planetPos) {
+        glUseProgram(shaderManager->program(shader));
+        uniforms.refresh(shaderManager, shader);
+
+        glUniform3f(uniforms.planetCentre, planetPos.x, planetPos.y, planetPos.z);
+        glUniform4f(uniforms.atmosphereShape, settings.planetRadius, settings.radius,
+                    settings.rayleighScaleHeight, settings.mieScaleHeight);
+        glUniform3f(uniforms.rayleighScattering, settings.rayleighScattering.x,
+                    settings.rayleighScattering.y, settings.rayleighScattering.z);
+        glUniform1f(uniforms.mieScattering, settings.mieScattering);
+        glUniform1f(uniforms.mieAnisotropy, settings.mieAnisotropy);
+        glUniform3f(uniforms.sunDirection, settings.sunDirection.x,
+                    settings.sunDirection.y, settings.sunDirection.z);
+        glUniform1f(uniforms.sunIntensity, settings.sunIntensity);
+        glUniform1i(uniforms.opticalDepthTable, 0);
+        CHECK_GL_ERRORS();
+    }
+
+    // Draws over whatever is already there, the planet included (so
+    // Bodies::draw leaves bodies in front of it until after). Binds the
+    // sky program; culling, depth test and blending are left as they were
+    // found in the main loop (back faces culled, depth on, alpha blending).
+    void draw(const v3 &cameraPos, const v3 &planetPos) {
+        inside = v3length(cameraPos - planetPos) < settings.radius;
+
+        setUniforms(planetPos);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, opticalDepthTexture);
+
+        // Output is premultiplied: in-scattered light, plus coverage from the
+        // view ray's transmittance
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_DEPTH_TEST);
+        glCullFace(GL_FRONT);
+
+        beginQuery();
+
+        for (int i = 0; i < numFaces; ++i) {
+            proxy[i].draw();
+            drawCalls += 1;
+            trianglesDrawn += proxy[i].numIndices - 2;
+        }
+
+        endQuery();
+
+        glCullFace(GL_BACK);
+        glEnable(GL_DEPTH_TEST);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        CHECK_GL_ERRORS();
+    }
+
+    void beginQuery() {
+        glBeginQuery(GL_SAMPLES_PASSED, queries[query]);
+    }
+
+    void endQuery() {
+        glEndQuery(GL_SAMPLES_PASSED);
+        queryPending[query] = true;
+
+        query = (query + 1) % numQueries;
+
+        // The oldest query is the one we'll reuse next frame
+        if (queryPending[query]) {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (available) {
+                GLuint result = 0;
+                glGetQueryObjectuiv(queries[query], GL_QUERY_RESULT, &result);
+                samplesPassed = result;
+            }
+            queryPending[query] = false;
+        }
+        CHECK_GL_ERRORS();
+    }
+
+    void destroy() {
+        for (int i = 0; i < numFaces; ++i) {
+            proxy[i].destroy();
+        }
+
+        if (opticalDepthTexture != 0) {
+            glDeleteTextures(1, &opticalDepthTexture);
+            opticalDepthTexture = 0;
+
+            gpuMemory.release(GpuMemoryTexture, sizeof(float) * 2 * tableWidth * tableHeight);
+        }
+
+        if (queries[0] != 0) {
+            glDeleteQueries(numQueries, queries);
+            for (int i = 0; i < numQueries; ++i) {
+                queries[i] = 0;
+                queryPending[i] = false;
+            }
+        }
+    }
+};
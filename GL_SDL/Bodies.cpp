@@ -0,0 +1,568 @@
+//
+//  Bodies.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Registry of celestial bodies: the home planet, its moons, whatever else.
+//
+// Each body has its own radius, seed, orbit and terrain settings, but they
+// all go through the same machinery. Terrain is built on the shared job
+// system, face meshes live in the shared mesh cache, and one culling pass
+// decides what gets drawn. Bodies that come out smaller than
+// `impostorPixels` on screen are drawn as a lit sphere on a single quad
+// (ImpostorVertex.glsl / ImpostorFragment.glsl). A body's terrain isn't
+// even generated until it's first seen up close, so a far-off moon costs a
+// quad and nothing else.
+//
+// Positions come from simple circular orbits around a parent, updated in
+// the fixed step (on rails, but with Kepler's periods if none are given).
+// Each body is also a point mass for the orbital mechanics, see Orbits.cpp.
+// Everything here is in world space; terrain queries take body-local
+// positions.
+
+#include <mutex>
+#include <chrono>
+
+// Unpacks TerrainVertex, lit by the sun
+const char *terrainVertexShader = "Assets/Shaders/TerrainVertex.glsl";
+const char *terrainFragmentShader = "Assets/Shaders/SimpleCameraLitFragment.glsl";
+
+const char *impostorVertexShader = "Assets/Shaders/ImpostorVertex.glsl";
+const char *impostorFragmentShader = "Assets/Shaders/ImpostorFragment.glsl";
+
+// Looked up again whenever the impostor program is rebuilt
+struct ImpostorUniforms {
+    int generation;
+    GLint sunDirection;
+    GLint centre;
+    GLint radius;
+    GLint colour;
+
+    ImpostorUniforms() {
+        generation = -1;
+    }
+
+    void refresh(ShaderManager *shaders, ShaderHandle shader) {
+        if (!shaders->changedSince(shader, generation)) {
+            return;
+        }
+
+        sunDirection = shaders->uniformLocation(shader, "sunDirection");
+        centre = shaders->uniformLocation(shader, "bodyCentre");
+        radius = shaders->uniformLocation(shader, "bodyRadius");
+        colour = shaders->uniformLocation(shader, "bodyColour");
+    }
+};
+
+struct BodySettings {
+    const char *name;
+    float radius;
+    uint32_t seed;
+    float heightMultiplier;         // See terrainHeightMultiplier
+    bool hasAtmosphere;
+
+    // Circular orbit around `parent` (-1 to stay put at `orbitRadius` along x)
+    int parent;
+    float orbitRadius;
+    float orbitPeriod;              // Seconds, 0 for whatever the parent's gravity gives
+    float orbitPhase;               // Radians
+    float orbitInclination;         // Radians, tipped about the x axis
+
+    float surfaceGravity;           // At sea level, units/s^2. Sets the mass.
+};
+
+// G * mass
+inline float bodyGravitationalParameter(const BodySettings &settings) {
+    return settings.surfaceGravity * settings.radius * settings.radius;
+}
+
+struct Body {
+    BodySettings settings;
+    v3 position;
+    v3 velocity;
+
+    NoiseContext noiseContext;
+    FractalNoise noise;
+    Terrain terrain;
+
+    Atmosphere *atmosphere;         // NULL if it doesn't have one
+
+    // Average terrain colour, for the impostor
+    v4 colour;
+};
+
+// What the culling pass decided for one body
+struct BodyView {
+    int body;
+    v3 position;
+    float pixels;                   // Projected diameter
+    bool impostor;
+    bool faceVisible[Terrain::numFaces];
+    int faceLevel[Terrain::numFaces];
+    uint64_t chunkVisible[Terrain::numFaces];   // See Bodies::occlusionCull
+};
+
+struct Bodies {
+    static const int maxBodies = 16;
+
+    Body *bodies[maxBodies];
+    int numBodies;
+
+    int squaresPerSide;
+    float impostorPixels;
+    v3 sunDirection;
+
+    ShaderManager *shaderManager;
+    ShaderHandle terrainShader;
+    ShaderHandle impostorShader;
+    TerrainUniforms terrainUniforms;
+    ImpostorUniforms impostorUniforms;
+    Mesh impostorQuad;
+
+    // Held by the simulation while it queries terrain and by the renderer
+    // while it builds or edits it
+    std::mutex lock;
+
+    // Simulation side, see occlusionCull()
+    OcclusionBuffer occlusion;
+
+    // Stats, reset by the caller
+    int detailedDrawn;
+    int impostorsDrawn;
+    int generating;
+    long terrainTriangles;
+    long terrainTrianglesCulled;
+
+    Bodies() {
+        numBodies = 0;
+        squaresPerSide = 100;
+        impostorPixels = 64.0;
+        sunDirection = v3(0.0, 0.0, 1.0);
+        shaderManager = NULL;
+        terrainShader = InvalidShader;
+        impostorShader = InvalidShader;
+
+        detailedDrawn = 0;
+        impostorsDrawn = 0;
+        generating = 0;
+        terrainTriangles = 0;
+        terrainTrianglesCulled = 0;
+    }
+
+    void init(ShaderManager *_shaderManager, int _squaresPerSide) {
+        shaderManager = _shaderManager;
+        squaresPerSide = _squaresPerSide;
+
+        // Corners of a unit quad, spread over the body's silhouette in the shader
+        v3 verts[4] = { v3(-1.0, -1.0, 0.0), v3(1.0, -1.0, 0.0), v3(-1.0, 1.0, 0.0), v3(1.0, 1.0, 0.0) };
+        v3 norms[4] = { v3(0.0, 0.0, 1.0), v3(0.0, 0.0, 1.0), v3(0.0, 0.0, 1.0), v3(0.0, 0.0, 1.0) };
+        v4 cols[4] = { v4(1.0, 1.0, 1.0, 1.0), v4(1.0, 1.0, 1.0, 1.0), v4(1.0, 1.0, 1.0, 1.0), v4(1.0, 1.0, 1.0, 1.0) };
+        ushort indices[4] = { 0, 1, 2, 3 };
+
+        impostorQuad.setup(4, verts, norms, cols, 4, indices);
+
+        terrainShader = shaderManager->load(terrainVertexShader, NULL, terrainFragmentShader,
+                                            terrainShaderAttributes, numTerrainShaderAttributes);
+        impostorShader = shaderManager->load(impostorVertexShader, NULL, impostorFragmentShader);
+
+        terrainUniforms.refresh(shaderManager, terrainShader);
+        impostorUniforms.refresh(shaderManager, impostorShader);
+    }
+
+    // Average colour of the generated terrain, from a spread of directions
+    v4 averageColour(Body *body) {
+        const int samples = 256;
+        v4 total(0.0, 0.0, 0.0, 0.0);
+
+        for (int i = 0; i < samples; ++i) {
+            // Fibonacci sphere
+            float z = 1.0 - (2.0 * i + 1.0) / samples;
+            float r = sqrt(fmax(1.0f - z * z, 0.0f));
+            float angle = i * 2.39996323;
+            v3 dir((float)(r * cos(angle)), (float)(r * sin(angle)), z);
+
+            v3 pt;
+            v4 col;
+            terrainVertex(dir, normalizedHeightAboveSeaLevel(body->noise, dir), body->settings.radius,
+                          body->settings.heightMultiplier, pt, col);
+
+            total.r += col.r;
+            total.g += col.g;
+            total.b += col.b;
+        }
+
+        return v4(total.r / samples, total.g / samples, total.b / samples, 1.0f);
+    }
+
+    // Parents have to be added before their children. Returns the body's index.
+    int add(const BodySettings &settings) {
+        if (numBodies >= maxBodies || settings.parent >= numBodies) {
+            printf("Bodies: can't add %s\n", settings.name);
+            return -1;
+        }
+
+        Body *body = new Body();
+        body->settings = settings;
+        body->position = v3(settings.orbitRadius, 0.0f, 0.0f);
+        body->velocity = v3(0.0f, 0.0f, 0.0f);
+
+        body->noiseContext.reseed(settings.seed);
+        body->noise = terrainNoise;
+        body->noise.context = &body->noiseContext;
+
+        // Nothing built yet, but queries fall back to the noise so the radius has to be right
+        body->terrain.radius = settings.radius;
+        body->terrain.noise = &body->noise;
+        body->terrain.heightMultiplier = settings.heightMultiplier;
+
+        body->atmosphere = NULL;
+        if (settings.hasAtmosphere) {
+            body->atmosphere = new Atmosphere();
+            body->atmosphere->build(earthLikeAtmosphere(settings.radius, settings.radius * (1.0 + 5.0 * settings.heightMultiplier)),
+                                    shaderManager);
+        }
+
+        body->colour = averageColour(body);
+
+        bodies[numBodies] = body;
+        numBodies += 1;
+
+        printf("Body %d: %s, radius %.0f, seed %u\n", numBodies - 1, settings.name, settings.radius, settings.seed);
+
+        return numBodies - 1;
+    }
+
+    // Builds a body's terrain straight away, e.g. wherever the camera starts
+    void generateNow(int index) {
+        Body *body = bodies[index];
+        if (!body->terrain.ready) {
+            body->terrain.build(squaresPerSide, body->settings.radius, &body->noise, body->settings.heightMultiplier);
+        }
+    }
+
+    // Simulation side
+    void update(double t) {
+        for (int i = 0; i < numBodies; ++i) {
+            Body *body = bodies[i];
+            const BodySettings &settings = body->settings;
+
+            if (settings.parent < 0) {
+                body->position = v3(settings.orbitRadius, 0.0f, 0.0f);
+                body->velocity = v3(0.0f, 0.0f, 0.0f);
+                continue;
+            }
+
+            Body *parent = bodies[settings.parent];
+
+            double period = settings.orbitPeriod;
+            if (period <= 0.0) {
+                double a = settings.orbitRadius;
+                period = 2.0 * M_PI * sqrt(a * a * a / bodyGravitationalParameter(parent->settings));
+            }
+
+            double rate = 2.0 * M_PI / period;
+            double angle = settings.orbitPhase + rate * t;
+            float x = settings.orbitRadius * cos(angle);
+            float y = settings.orbitRadius * sin(angle);
+            float dx = -settings.orbitRadius * rate * sin(angle);
+            float dy = settings.orbitRadius * rate * cos(angle);
+
+            float c = cos(settings.orbitInclination);
+            float s = sin(settings.orbitInclination);
+
+            body->position = parent->position + v3(x, y * c, y * s);
+            body->velocity = parent->velocity + v3(dx, dy * c, dy * s);
+        }
+    }
+
+    // Every body as a point mass, simulation side
+    void gravitySources(GravitySources &sources) {
+        sources.count = 0;
+
+        for (int i = 0; i < numBodies; ++i) {
+            const BodySettings &settings = bodies[i]->settings;
+            sources.add(bodies[i]->position, bodyGravitationalParameter(settings), settings.radius);
+        }
+    }
+
+    // Body whose surface is closest to `pos` (by sea level), or -1 if there aren't any
+    int nearest(const v3 &pos) {
+        int best = -1;
+        float bestDistance = 0.0;
+
+        for (int i = 0; i < numBodies; ++i) {
+            float distance = v3length(pos - bodies[i]->position) - bodies[i]->settings.radius;
+            if (best < 0 || distance < bestDistance) {
+                best = i;
+                bestDistance = distance;
+            }
+        }
+
+        return best;
+    }
+
+    float boundingRadius(Body *body) {
+        float radius = body->settings.radius + body->terrain.maxSurfaceHeight();
+        if (body->atmosphere) {
+            radius = fmax(radius, body->atmosphere->settings.radius);
+        }
+        return radius;
+    }
+
+    // The one culling pass: which bodies are in the view cone, and which of
+    // those get real terrain. Returns the number of views written.
+    int cull(const v3 &cameraPos, const v3 &viewDirection, float fieldOfView, float aspect, float screenHeight,
+             BodyView *views) {
+        float fovRadians = degToRad(fieldOfView);
+        float viewAngle = atan(tan(0.5 * fovRadians) * sqrt(1.0 + aspect * aspect));
+
+        int numViews = 0;
+
+        for (int i = 0; i < numBodies; ++i) {
+            Body *body = bodies[i];
+
+            v3 offset = body->position - cameraPos;
+            float distance = v3length(offset);
+            float bounds = boundingRadius(body);
+
+            float pixels = screenHeight;
+
+            if (distance > bounds) {
+                float halfAngle = asin(bounds / distance);
+                float angle = acos(fmax(fmin(v3dot(offset, viewDirection) / distance, 1.0f), -1.0f));
+
+                if (angle - halfAngle > viewAngle) {
+                    continue;
+                }
+
+                pixels = screenHeight * 2.0 * asin(body->settings.radius / distance) / fovRadians;
+                if (pixels < 0.5) {
+                    continue;
+                }
+            }
+
+            BodyView &view = views[numViews];
+            view.body = i;
+            view.position = body->position;
+            view.pixels = pixels;
+            view.impostor = pixels < impostorPixels;
+
+            if (!view.impostor) {
+                body->terrain.visibleFaces(cameraPos - body->position, view.faceVisible);
+                body->terrain.faceLevels(cameraPos - body->position, view.faceLevel);
+
+                for (int face = 0; face < Terrain::numFaces; ++face) {
+                    view.chunkVisible[face] = allTerrainChunks;
+                }
+            }
+
+            numViews += 1;
+        }
+
+        return numViews;
+    }
+
+    // Second pass over cull()'s views: every built terrain in them draws its
+    // occluders into one buffer, then has each chunk of its visible faces
+    // tested against the lot. Chunks that are hidden, or off screen, are
+    // left out of chunkVisible. Mostly pays off low down, where nearby hills
+    // hide the ground behind them.
+    OcclusionStats occlusionCull(const OcclusionCamera &camera, BodyView *views, int numViews) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        occlusion.begin(camera);
+
+        for (int i = 0; i < numViews; ++i) {
+            Body *body = bodies[views[i].body];
+            if (!views[i].impostor && body->terrain.ready) {
+                body->terrain.drawOccluders(occlusion, body->position - camera.position, views[i].faceVisible);
+            }
+        }
+
+        occlusion.finish();
+
+        for (int i = 0; i < numViews; ++i) {
+            Body *body = bodies[views[i].body];
+            if (!views[i].impostor && body->terrain.ready) {
+                body->terrain.testChunks(occlusion, body->position - camera.position, views[i].faceVisible,
+                                         views[i].chunkVisible);
+            }
+        }
+
+        occlusion.stats.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return occlusion.stats;
+    }
+
+    // Render side. Bodies that want detail but haven't been generated yet
+    // start building on the job system and show as impostors until they're
+    // ready.
+    //
+    // The sky shader only stops its rays at its own planet, so it would haze
+    // over a moon in front of it. Bodies nearer the camera than every body
+    // with an atmosphere are drawn after the skies instead; the rest go
+    // first and get the skies over them. Leaves blending off.
+    void draw(const BodyView *views, int numViews, const v3 &cameraPos) {
+        generating = 0;
+
+        float nearestSky = FLT_MAX;
+        for (int i = 0; i < numViews; ++i) {
+            if (bodies[views[i].body]->atmosphere) {
+                nearestSky = fmin(nearestSky, v3length(views[i].position - cameraPos));
+            }
+        }
+
+        bool afterSkies[maxBodies];
+        bool anyAfterSkies = false;
+        for (int i = 0; i < numViews; ++i) {
+            afterSkies[i] = bodies[views[i].body]->atmosphere == NULL &&
+                            v3length(views[i].position - cameraPos) < nearestSky;
+            anyAfterSkies = anyAfterSkies || afterSkies[i];
+        }
+
+        drawSurfaces(views, numViews, afterSkies, false);
+
+        for (int i = 0; i < numViews; ++i) {
+            Body *body = bodies[views[i].body];
+            if (body->atmosphere) {
+                body->atmosphere->draw(cameraPos, views[i].position);
+            }
+        }
+
+        glDisable(GL_BLEND);
+        if (anyAfterSkies) {
+            drawSurfaces(views, numViews, afterSkies, true);
+        }
+
+        // Keep anything still building moving along even when it's out of view
+        for (int i = 0; i < numBodies; ++i) {
+            if (bodies[i]->terrain.building) {
+                std::lock_guard<std::mutex> guard(lock);
+                bodies[i]->terrain.pollBuild();
+            }
+        }
+    }
+
+    // Terrain (moved into place with the modelOffset uniform), then
+    // impostors, for the views whose afterSkies matches `late`
+    void drawSurfaces(const BodyView *views, int numViews, const bool *afterSkies, bool late) {
+        bool useImpostor[maxBodies];
+
+        glUseProgram(shaderManager->program(terrainShader));
+        terrainUniforms.refresh(shaderManager, terrainShader);
+        glUniform3f(terrainUniforms.sunDirection, sunDirection.x, sunDirection.y, sunDirection.z);
+        glUniform1i(terrainUniforms.palette, 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        bindTerrainPalette();
+
+        for (int i = 0; i < numViews; ++i) {
+            const BodyView &view = views[i];
+            Body *body = bodies[view.body];
+
+            useImpostor[i] = false;
+
+            if (afterSkies[i] != late) {
+                continue;
+            }
+
+            useImpostor[i] = view.impostor;
+
+            if (view.impostor) {
+                continue;
+            }
+
+            bool ready;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+
+                if (!body->terrain.ready && !body->terrain.building) {
+                    body->terrain.startBuild(squaresPerSide, body->settings.radius, &body->noise, body->settings.heightMultiplier);
+                }
+
+                ready = body->terrain.pollBuild();
+            }
+
+            if (!ready) {
+                useImpostor[i] = true;
+                generating += 1;
+                continue;
+            }
+
+            glUniform3f(terrainUniforms.modelOffset, view.position.x, view.position.y, view.position.z);
+            body->terrain.setShapeUniform(terrainUniforms);
+
+            for (int face = 0; face < Terrain::numFaces; ++face) {
+                if (view.faceVisible[face]) {
+                    body->terrain.drawFace(face, view.faceLevel, view.chunkVisible[face], terrainUniforms);
+                }
+            }
+            detailedDrawn += 1;
+        }
+
+        glUniform3f(terrainUniforms.modelOffset, 0.0, 0.0, 0.0);
+        glBindTexture(GL_TEXTURE_1D, 0);
+
+        glUseProgram(shaderManager->program(impostorShader));
+        impostorUniforms.refresh(shaderManager, impostorShader);
+        glUniform3f(impostorUniforms.sunDirection, sunDirection.x, sunDirection.y, sunDirection.z);
+
+        for (int i = 0; i < numViews; ++i) {
+            if (!useImpostor[i]) {
+                continue;
+            }
+
+            const BodyView &view = views[i];
+            Body *body = bodies[view.body];
+
+            glUniform3f(impostorUniforms.centre, view.position.x, view.position.y, view.position.z);
+            glUniform1f(impostorUniforms.radius, body->settings.radius);
+            glUniform4f(impostorUniforms.colour, body->colour.r, body->colour.g, body->colour.b, body->colour.a);
+
+            impostorQuad.draw();
+            impostorsDrawn += 1;
+        }
+    }
+
+    void recordStats(long screenSamples) {
+        frameStats.recordBodies(numBodies, detailedDrawn, impostorsDrawn, generating);
+        detailedDrawn = 0;
+        impostorsDrawn = 0;
+
+        for (int i = 0; i < numBodies; ++i) {
+            Atmosphere *atmosphere = bodies[i]->atmosphere;
+            if (atmosphere) {
+                frameStats.recordAtmosphere(atmosphere->inside, atmosphere->drawCalls, atmosphere->trianglesDrawn,
+                                            atmosphere->samplesPassed, screenSamples);
+                atmosphere->drawCalls = 0;
+                atmosphere->trianglesDrawn = 0;
+            }
+
+            terrainTriangles += bodies[i]->terrain.trianglesDrawn;
+            terrainTrianglesCulled += bodies[i]->terrain.trianglesCulled;
+            bodies[i]->terrain.trianglesDrawn = 0;
+            bodies[i]->terrain.trianglesCulled = 0;
+        }
+
+        frameStats.recordTerrainTriangles(terrainTriangles, terrainTrianglesCulled);
+        terrainTriangles = 0;
+        terrainTrianglesCulled = 0;
+    }
+
+    void destroy() {
+        for (int i = 0; i < numBodies; ++i) {
+            bodies[i]->terrain.destroy();
+            if (bodies[i]->atmosphere) {
+                bodies[i]->atmosphere->destroy();
+                delete bodies[i]->atmosphere;
+            }
+            delete bodies[i];
+        }
+        numBodies = 0;
+
+        impostorQuad.destroy();
+        destroyTerrainPalette();
+    }
+};
@@ -0,0 +1,124 @@
+//
+//  CubeSphere.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Mapping between cube face grids and the sphere.
+//
+// Pushing a uniform face grid straight through v3normalize (gnomonic) packs
+// vertices about twice as tightly along each axis at the face corners as at
+// the centres. The tangent warp spaces grid lines evenly by angle instead,
+// so the edges come out much more uniform and fewer squares per side give
+// the same worst-case edge length.
+//
+// Grid coordinates u, v run 0..1 across and up a face. Everything that goes
+// from grid to sphere or back (mesh generation, height lookups, edits) has
+// to agree on the projection, so change it before building the terrain.
+
+typedef enum {
+    CubeProjectionGnomonic,
+    CubeProjectionTangent,
+} CubeProjection;
+
+CubeProjection cubeProjection = CubeProjectionTangent;
+
+// Grid coordinate (0..1) to position along the face plane (0..1)
+inline float warpFaceCoordinate(float t, CubeProjection projection = cubeProjection) {
+    if (projection == CubeProjectionTangent) {
+        return 0.5 + 0.5 * tan(M_PI_4 * (2.0 * t - 1.0));
+    }
+    return t;
+}
+
+// Position along the face plane (0..1) back to grid coordinate (0..1)
+inline float unwarpFaceCoordinate(float t, CubeProjection projection = cubeProjection) {
+    if (projection == CubeProjectionTangent) {
+        return 0.5 + 0.5 * atan(2.0 * t - 1.0) / M_PI_4;
+    }
+    return t;
+}
+
+// Unit direction for grid point (u, v) on the face spanning startPt + [0,1] * acrossDir + [0,1] * upDir
+inline v3 cubeFaceDirection(const v3 &startPt, const v3 &acrossDir, const v3 &upDir, float u, float v,
+                            CubeProjection projection = cubeProjection) {
+    return v3normalize(startPt + warpFaceCoordinate(u, projection) * acrossDir
+                       + warpFaceCoordinate(v, projection) * upDir);
+}
+
+// Largest number of grid squares per radian of arc anywhere on a face,
+// relative to the face plane (which is at most 3 units per radian)
+inline float cubeProjectionGridStretch(CubeProjection projection = cubeProjection) {
+    if (projection == CubeProjectionTangent) {
+        return 4.0 / M_PI;
+    }
+    return 1.0;
+}
+
+const char *cubeProjectionName(CubeProjection projection) {
+    return projection == CubeProjectionTangent ? "tangent" : "gnomonic";
+}
+
+struct CubeProjectionStats {
+    CubeProjection projection;
+    int squaresPerSide;
+    int triangles;      // For the whole sphere
+    float minEdge;      // Grid edge lengths on the unit sphere
+    float maxEdge;
+};
+
+// Every face is the same up to rotation, so one face tells us everything
+CubeProjectionStats measureCubeProjection(CubeProjection projection, int squaresPerSide) {
+    CubeProjectionStats stats;
+    stats.projection = projection;
+    stats.squaresPerSide = squaresPerSide;
+    stats.triangles = 6 * 2 * squaresPerSide * squaresPerSide;
+    stats.minEdge = 10.0;
+    stats.maxEdge = 0.0;
+
+    v3 startPt(1.0, -1.0, -1.0);
+    v3 acrossDir(0.0, 2.0, 0.0);
+    v3 upDir(0.0, 0.0, 2.0);
+
+    float step = 1.0 / squaresPerSide;
+
+    for (int j = 0; j <= squaresPerSide; ++j) {
+        for (int i = 0; i < squaresPerSide; ++i) {
+            // Edge (i, j)-(i+1, j) and, by symmetry, its transpose
+            v3 a = cubeFaceDirection(startPt, acrossDir, upDir, i * step, j * step, projection);
+            v3 b = cubeFaceDirection(startPt, acrossDir, upDir, (i + 1) * step, j * step, projection);
+
+            float edge = v3length(b - a);
+
+            if (edge < stats.minEdge) stats.minEdge = edge;
+            if (edge > stats.maxEdge) stats.maxEdge = edge;
+        }
+    }
+
+    return stats;
+}
+
+// Fewest squares per side whose longest edge is no longer than `maxEdge`
+int cubeProjectionSquaresForMaxEdge(CubeProjection projection, float maxEdge, int limit = 254) {
+    int squares = 1;
+    while (squares < limit && measureCubeProjection(projection, squares).maxEdge > maxEdge) {
+        squares += 1;
+    }
+    return squares;
+}
+
+// What cubeProjectionSquaresForMaxEdge() gives against the original 128
+// square gnomonic grid, rounded up to even so distant faces can drop to every
+// other vertex. Written down so startup doesn't search for it; --report
+// works it out again and says if it has drifted.
+inline int cubeProjectionSquaresPerSide(CubeProjection projection = cubeProjection) {
+    return projection == CubeProjectionTangent ? 102 : 128;
+}
+
+void printCubeProjectionStats(const CubeProjectionStats &stats) {
+    printf("Cube projection %s: %d squares/side, %d triangles, edges %.5f - %.5f (ratio %.2f)\n",
+           cubeProjectionName(stats.projection), stats.squaresPerSide, stats.triangles,
+           stats.minEdge, stats.maxEdge, stats.maxEdge / stats.minEdge);
+}
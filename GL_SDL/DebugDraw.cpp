@@ -0,0 +1,115 @@
+//
+//  DebugDraw.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Immediate mode lines for diagnostics. Vertices are written straight into
+// this frame's slice of a StreamBuffer between begin() and draw(), then
+// drawn with whatever program is current (the camera shader layout).
+
+struct DebugVertex {
+    v3 position;
+    v4 color;
+};
+
+struct DebugDraw {
+    static const int maxVertices = 16384;
+
+    StreamBuffer stream;
+    GLuint vao = 0;
+
+    StreamAllocation allocation;
+    DebugVertex *vertices = NULL;
+    int numVertices = 0;
+
+    void init() {
+        glGenVertexArrays(1, &vao);
+        CHECK_GL_ERRORS();
+
+        // Room for a full batch in each of the ring's segments
+        stream.init(GL_ARRAY_BUFFER, maxVertices * sizeof(DebugVertex));
+    }
+
+    void begin() {
+        numVertices = 0;
+        vertices = NULL;
+
+        if (stream.allocate(maxVertices * sizeof(DebugVertex), sizeof(float), allocation)) {
+            vertices = (DebugVertex *)allocation.data;
+        }
+    }
+
+    void line(const v3 &a, const v3 &b, const v4 &color) {
+        if (vertices == NULL || numVertices + 2 > maxVertices) {
+            return;
+        }
+
+        vertices[numVertices].position = a;
+        vertices[numVertices].color = color;
+        vertices[numVertices + 1].position = b;
+        vertices[numVertices + 1].color = color;
+
+        numVertices += 2;
+    }
+
+    // Great circle arc from direction a to direction b at the given radius
+    void arc(const v3 &a, const v3 &b, float radius, int segments, const v4 &color) {
+        v3 prev = radius * v3normalize(a);
+
+        for (int i = 1; i <= segments; ++i) {
+            float t = (float)i / segments;
+            v3 next = radius * v3normalize((1.0f - t) * a + t * b);
+            line(prev, next, color);
+            prev = next;
+        }
+    }
+
+    void draw() {
+        if (vertices == NULL) {
+            return;
+        }
+
+        stream.trim(allocation, numVertices * sizeof(DebugVertex));
+        stream.commit(allocation);
+        vertices = NULL;
+
+        if (numVertices == 0) {
+            return;
+        }
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+
+        const GLsizei stride = sizeof(DebugVertex);
+        const char *base = (const char *)0 + allocation.offset;
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, base);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, base + sizeof(v3));
+        glEnableVertexAttribArray(2);
+
+        // No per-vertex normals, just point them at the viewer's side
+        glDisableVertexAttribArray(1);
+        glVertexAttrib3f(1, 0.0, 0.0, 1.0);
+        CHECK_GL_ERRORS();
+
+        glDrawArrays(GL_LINES, 0, numVertices);
+        CHECK_GL_ERRORS();
+    }
+
+    void endFrame() {
+        stream.endFrame();
+    }
+
+    void destroy() {
+        stream.destroy();
+
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+            vao = 0;
+        }
+    }
+};
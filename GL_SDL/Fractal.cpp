@@ -0,0 +1,226 @@
+//
+//  Fractal.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Multi-octave noise built on the 3D simplex noise() in Noise.cpp.
+//
+// Per-octave frequencies, amplitudes and the "most the remaining octaves
+// could still add" bound are worked out once in setup(), so evaluate() is a
+// single loop with no pow() calls. The loop stops as soon as the remaining
+// octaves can't move the result by more than the tolerance, or can't lift it
+// back up to the caller's floor (e.g. sea level, where the terrain flattens
+// out), or once the octave wavelength drops below what the caller's vertex
+// spacing can show.
+
+typedef enum {
+    FractalTypeFBm,     // Plain sum of octaves
+    FractalTypeRidged,  // Sharp crests, (1 - |n|)^2
+    FractalTypeBillow,  // Rounded lumps, 2|n| - 1
+} FractalType;
+
+struct FractalNoise {
+    static const int maxOctaves = 16;
+
+    const NoiseContext *context;
+
+    FractalType type;
+    int numOctaves;
+
+    double frequencies[maxOctaves];
+    double amplitudes[maxOctaves];
+
+    // Most a single unit-amplitude octave can add, either way
+    double kernelPeak;
+
+    // remaining[i] is the largest change octaves i+1.. can make to the result
+    double remaining[maxOctaves];
+
+    FractalNoise() {
+        setup(FractalTypeFBm, 1, 1.0, 2.0, 0.5);
+    }
+
+    void setup(FractalType _type, int octaves, double frequency, double lacunarity, double gain,
+               const NoiseContext *_context = &defaultNoiseContext) {
+        context = _context;
+        type = _type;
+        numOctaves = octaves;
+
+        if (numOctaves < 1) {
+            numOctaves = 1;
+        } else if (numOctaves > maxOctaves) {
+            numOctaves = maxOctaves;
+        }
+
+        double amplitude = 1.0;
+
+        for (int i = 0; i < numOctaves; ++i) {
+            frequencies[i] = frequency;
+            amplitudes[i] = amplitude;
+
+            frequency *= lacunarity;
+            amplitude *= gain;
+        }
+
+        // The ridged and billow kernels can reach 1, but plain noise stops
+        // well short of it. A loose bound here leaves nothing for the
+        // early-outs in evaluate() to skip.
+        kernelPeak = type == FractalTypeFBm ? noisePeak : 1.0;
+
+        double tail = 0.0;
+        for (int i = numOctaves - 1; i >= 0; --i) {
+            remaining[i] = tail;
+            tail += kernelPeak * amplitudes[i];
+        }
+    }
+
+    // Most the result can be either side of zero
+    double maxValue() {
+        return kernelPeak * amplitudes[0] + remaining[0];
+    }
+
+    // LOD helper: number of octaves worth evaluating when samples are
+    // `spacing` apart on the unit sphere (anything finer just aliases)
+    int octavesForSpacing(double spacing) {
+        if (spacing <= 0.0) {
+            return numOctaves;
+        }
+
+        double maxFrequency = 0.5 / spacing;
+
+        int octaves = 1;
+        while (octaves < numOctaves && frequencies[octaves] <= maxFrequency) {
+            octaves += 1;
+        }
+
+        return octaves;
+    }
+
+    // LOD helper: narrowest noise precision whose worst case error, summed
+    // over every octave, stays under `allowedError` (in noise units)
+    NoisePrecision precisionForError(const NoiseAccuracy &accuracy, double allowedError) {
+        // Per-octave error scales with its amplitude, not with what it returns
+        double scale = 0.0;
+        for (int i = 0; i < numOctaves; ++i) {
+            scale += amplitudes[i];
+        }
+
+        if (accuracy.maxError[NoisePrecisionFixed] * scale <= allowedError) {
+            return NoisePrecisionFixed;
+        }
+
+        if (accuracy.maxError[NoisePrecisionFloat] * scale <= allowedError) {
+            return NoisePrecisionFloat;
+        }
+
+        return NoisePrecisionDouble;
+    }
+
+    // `pt` is a point on the unit sphere (already normalised by the caller).
+    // Results under `floor` are only as exact as the octaves taken so far,
+    // but are always still under it.
+    double evaluate(const v3 &pt, double tolerance = 0.0, int octaveLimit = maxOctaves,
+                    NoisePrecision precision = NoisePrecisionDouble, int *octavesUsed = NULL,
+                    double floor = -HUGE_VAL) {
+        const NoiseContext &ctx = *context;
+
+        double x = pt.x;
+        double y = pt.y;
+        double z = pt.z;
+
+        int octaves = octaveLimit < numOctaves ? octaveLimit : numOctaves;
+
+        double value = 0.0;
+        int i = 0;
+
+        while (i < octaves) {
+            double n = noise(ctx, frequencies[i] * x, frequencies[i] * y, frequencies[i] * z, precision);
+
+            switch (type) {
+                case FractalTypeRidged:
+                    n = 1.0 - fabs(n);
+                    n = n * n;
+                    break;
+
+                case FractalTypeBillow:
+                    n = 2.0 * fabs(n) - 1.0;
+                    break;
+
+                default:
+                    break;
+            }
+
+            value += amplitudes[i] * n;
+            i += 1;
+
+            if (remaining[i - 1] <= tolerance || value + remaining[i - 1] < floor) {
+                break;
+            }
+        }
+
+        if (octavesUsed) {
+            *octavesUsed = i;
+        }
+
+        return value;
+    }
+};
+
+// What the early-outs in FractalNoise::evaluate() save, and what they cost,
+// against evaluating every octave
+struct OctaveSkipping {
+    int numOctaves;
+    double octavesPerPoint;
+    double stoppedEarly;        // Fraction of points
+    double maxError;            // Where the full result is at or over the floor
+    int floorCrossings;         // Points that came out on the wrong side of it
+};
+
+OctaveSkipping measureOctaveSkipping(FractalNoise &noise, double tolerance, double floor, int numSamples) {
+    OctaveSkipping result;
+    result.numOctaves = noise.numOctaves;
+    result.maxError = 0.0;
+    result.floorCrossings = 0;
+
+    long octaves = 0;
+    int stopped = 0;
+
+    // Fibonacci sphere, as in measureNoiseAccuracy()
+    const double goldenAngle = M_PI * (3.0 - sqrt(5.0));
+
+    for (int i = 0; i < numSamples; ++i) {
+        double z = 1.0 - (2.0 * i + 1.0) / numSamples;
+        double r = sqrt(1.0 - z * z);
+        double theta = goldenAngle * i;
+        v3 pt(r * cos(theta), r * sin(theta), z);
+
+        int used;
+        double full = noise.evaluate(pt);
+        double value = noise.evaluate(pt, tolerance, FractalNoise::maxOctaves, NoisePrecisionDouble, &used, floor);
+
+        octaves += used;
+        if (used < noise.numOctaves) {
+            stopped += 1;
+        }
+
+        if ((full >= floor) != (value >= floor)) {
+            result.floorCrossings += 1;
+        } else if (full >= floor && fabs(full - value) > result.maxError) {
+            result.maxError = fabs(full - value);
+        }
+    }
+
+    result.octavesPerPoint = numSamples > 0 ? (double)octaves / numSamples : 0.0;
+    result.stoppedEarly = numSamples > 0 ? (double)stopped / numSamples : 0.0;
+
+    return result;
+}
+
+void printOctaveSkipping(const OctaveSkipping &skipping) {
+    printf("Octave early-out: %.2f of %d octaves/point, %.1f%% stopped early, max error %.2e above the floor, %d floor crossings\n",
+           skipping.octavesPerPoint, skipping.numOctaves, 100.0 * skipping.stoppedEarly,
+           skipping.maxError, skipping.floorCrossings);
+}
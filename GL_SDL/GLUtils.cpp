@@ -31,12 +31,9 @@ typedef enum {
     ShaderTypeGeometry,
 } ShaderType;
 
-GLuint compileShader(const char *shaderFilename, ShaderType shaderType) {
-    GLchar *shaderSource;
+GLuint compileShaderSource(const GLchar *shaderSource, ShaderType shaderType, const char *shaderName) {
     GLuint shader;
     
-    shaderSource = fileToCharArray(shaderFilename);
-    
     switch (shaderType) {
         case ShaderTypeVertex:
         shader = glCreateShader(GL_VERTEX_SHADER);
@@ -60,8 +57,6 @@ GLuint compileShader(const char *shaderFilename, ShaderType shaderType) {
     glCompileShader(shader);
     CHECK_GL_ERRORS();
     
-    free(shaderSource);
-    
     int isShaderCompiled;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &isShaderCompiled);
     
@@ -73,50 +68,107 @@ GLuint compileShader(const char *shaderFilename, ShaderType shaderType) {
         
         glGetShaderInfoLog(shader, maxLength, &maxLength, infoLog);
         
-        printf("Error compiling shader: %s\n", shaderFilename);
+        printf("Error compiling shader: %s\n", shaderName);
         printf("Error: %s\n", infoLog);
         free(infoLog);
+        glDeleteShader(shader);
         return 0;
     }
     
     return shader;
 }
 
-GLuint linkShaders(GLuint vertexShader, GLuint geometryShader, GLuint fragmentShader) {
+GLuint compileShader(const char *shaderFilename, ShaderType shaderType) {
+    GLchar *shaderSource;
+    GLuint shader;
+    
+    shaderSource = fileToCharArray(shaderFilename);
+    
+    if (!shaderSource) {
+        printf("Error reading shader: %s\n", shaderFilename);
+        return 0;
+    }
+    
+    shader = compileShaderSource(shaderSource, shaderType, shaderFilename);
+    
+    free(shaderSource);
+    
+    return shader;
+}
+
+struct ShaderAttribute {
+    GLuint index;
+    const char *name;
+};
+
+// The layout Mesh::setup uploads to
+const ShaderAttribute defaultShaderAttributes[] = {
+    {0, "in_Position"},
+    {1, "in_Normal"},
+    {2, "in_Color"},
+};
+const int numDefaultShaderAttributes = sizeof(defaultShaderAttributes) / sizeof(defaultShaderAttributes[0]);
+
+bool checkProgramLinked(GLuint shaderProgram, const char *programName) {
+    int isLinked;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &isLinked);
+    if (isLinked == FALSE) {
+        int maxLength;
+        glGetProgramiv(shaderProgram, GL_INFO_LOG_LENGTH, &maxLength);
+        
+        if (maxLength > 0) {
+            char *infoLog = (char *)malloc(maxLength);
+            
+            glGetProgramInfoLog(shaderProgram, maxLength, &maxLength, infoLog);
+            
+            printf("Error linking program: %s\n", programName);
+            printf("Error: %s\n", infoLog);
+            free(infoLog);
+        } else {
+            printf("Error linking program: %s\n", programName);
+        }
+        
+        return false;
+    }
+    
+    return true;
+}
+
+// `programName` is only for error messages
+GLuint linkShaders(GLuint vertexShader, GLuint geometryShader, GLuint fragmentShader, const char *programName,
+                   const ShaderAttribute *attributes = defaultShaderAttributes,
+                   int numAttributes = numDefaultShaderAttributes,
+                   bool retrievable = false) {
     GLuint shaderProgram = glCreateProgram();
     
     /* Attach our shaders to our program */
     glAttachShader(shaderProgram, vertexShader);
     CHECK_GL_ERRORS();
-    //    glAttachShader(shaderProgram, geometryShader);
+    if (geometryShader != 0) {
+        glAttachShader(shaderProgram, geometryShader);
+        CHECK_GL_ERRORS();
+    }
     glAttachShader(shaderProgram, fragmentShader);
     CHECK_GL_ERRORS();
     
-    // TODO: (George) Handle this in a more re-usable way
-    glBindAttribLocation(shaderProgram, 0, "in_Position");
-    CHECK_GL_ERRORS();
-    glBindAttribLocation(shaderProgram, 1, "in_Normal");
-    CHECK_GL_ERRORS();
-    glBindAttribLocation(shaderProgram, 2, "in_Color");
-    CHECK_GL_ERRORS();
+    for (int i = 0; i < numAttributes; ++i) {
+        glBindAttribLocation(shaderProgram, attributes[i].index, attributes[i].name);
+        CHECK_GL_ERRORS();
+    }
+    
+    if (retrievable) {
+        // Ask the driver to keep the binary around so it can be cached (GL 4.1 / ARB_get_program_binary)
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        CHECK_GL_ERRORS();
+    }
     
     glLinkProgram(shaderProgram);
     CHECK_GL_ERRORS();
 
-    int isLinked;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &isLinked);
-    if (isLinked == FALSE) {
-        int maxLength;
-        glGetProgramiv(shaderProgram, GL_INFO_LOG_LENGTH, &maxLength);
-        
-        char *infoLog = (char *)malloc(maxLength);
-        
-        glGetProgramInfoLog(shaderProgram, maxLength, &maxLength, infoLog);
-        
-        free(infoLog);
-        
+    if (!checkProgramLinked(shaderProgram, programName)) {
+        glDeleteProgram(shaderProgram);
         return 0;
     }
     
     return shaderProgram;
-}
\ No newline at end of file
+}
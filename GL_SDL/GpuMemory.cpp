@@ -0,0 +1,76 @@
+//
+//  GpuMemory.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Running totals of buffer memory we've handed to GL. Everything that calls
+// glBufferData (or glBufferStorage, glTexImage*) reports the size here, so the
+// stats can show what's live and MeshCache (Mesh.cpp) knows when to start evicting.
+
+typedef enum {
+    GpuMemoryVertex,
+    GpuMemoryIndex,
+    GpuMemoryUniform,
+    GpuMemoryStream,
+    GpuMemoryTexture,
+    NumGpuMemoryKinds,
+} GpuMemoryKind;
+
+struct GpuMemory {
+    GpuMemory() {
+        budget = 256 * 1024 * 1024;
+        total = 0;
+        peak = 0;
+        frame = 0;
+
+        evictions = 0;
+        restores = 0;
+        evictedBytes = 0;
+
+        for (int i = 0; i < NumGpuMemoryKinds; ++i) {
+            bytes[i] = 0;
+        }
+    }
+
+    // Soft limit; evictable meshes are dropped once we go over it
+    long budget;
+
+    long bytes[NumGpuMemoryKinds];
+    long total;
+    long peak;
+
+    // Advanced once per rendered frame, used as the LRU clock
+    int frame;
+
+    // Stats, reset by the caller
+    int evictions;
+    int restores;
+    long evictedBytes;
+
+    // Report a buffer changing size, e.g. resize(kind, oldSize, newSize)
+    void resize(GpuMemoryKind kind, long oldBytes, long newBytes) {
+        bytes[kind] += newBytes - oldBytes;
+        total += newBytes - oldBytes;
+
+        if (total > peak) {
+            peak = total;
+        }
+    }
+
+    void allocate(GpuMemoryKind kind, long size) {
+        resize(kind, 0, size);
+    }
+
+    void release(GpuMemoryKind kind, long size) {
+        resize(kind, size, 0);
+    }
+
+    bool overBudget() {
+        return total > budget;
+    }
+};
+
+GpuMemory gpuMemory;
@@ -0,0 +1,348 @@
+//
+//  Jobs.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Job system: a fixed pool of worker threads, one deque of jobs each.
+//
+// A thread pushes and pops jobs at the back of its own deque (newest first,
+// so data is still warm) and, when that runs dry, steals from the front of
+// somebody else's. The main thread is worker 0 and only runs jobs while it
+// waits on a counter. Other threads that submit jobs (the pipelined
+// simulation thread) register for a deque of their own after the workers'.
+//
+// Every job can decrement a JobCounter when it finishes; wait() blocks until
+// a counter reaches zero, running that counter's jobs in the meantime. A job
+// can also depend on a counter, in which case it's parked on that counter
+// and only queued once the counter hits zero.
+//
+// Jobs must not touch GL - that stays on the main thread.
+
+#include <assert.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <vector>
+
+typedef void (*JobFunc)(void *data);
+
+struct JobCounter;
+
+struct Job {
+    JobFunc func;
+    void *data;
+    JobCounter *counter;    // Decremented when the job finishes, may be NULL
+};
+
+struct JobCounter {
+    std::atomic<int> count;
+
+    // Jobs waiting for this counter to reach zero
+    std::mutex lock;
+    std::vector<Job> waiting;
+
+    JobCounter() : count(0) {}
+};
+
+struct JobQueue {
+    std::mutex lock;
+    std::deque<Job> jobs;
+};
+
+struct JobSystem {
+    static const int maxWorkers = 32;
+    static const int maxExternalThreads = 4;
+    static const int maxSlots = maxWorkers + maxExternalThreads;
+
+    int numWorkers;     // Including the main thread
+    std::thread threads[maxWorkers];
+
+    // Workers' deques, then registered threads' from numWorkers on
+    JobQueue queues[maxSlots];
+    std::atomic<int> numExternal;
+
+    std::atomic<bool> running;
+    std::atomic<int> queued;
+
+    // Idle workers sleep here until something is queued
+    std::mutex sleepLock;
+    std::condition_variable wake;
+
+    // Per slot stats, reset by the caller
+    std::atomic<long> busyMicroseconds[maxSlots];
+    std::atomic<int> jobsRun[maxSlots];
+    std::atomic<int> steals[maxSlots];
+
+    JobSystem() : numExternal(0), running(false), queued(0) {
+        numWorkers = 1;
+        resetStats();
+    }
+
+    void resetStats() {
+        for (int i = 0; i < maxSlots; ++i) {
+            busyMicroseconds[i] = 0;
+            jobsRun[i] = 0;
+            steals[i] = 0;
+        }
+    }
+
+    // 0 workers means one per hardware thread (the main thread counts as one)
+    void init(int workers = 0) {
+        if (workers <= 0) {
+            workers = std::thread::hardware_concurrency();
+        }
+        if (workers < 1) {
+            workers = 1;
+        } else if (workers > maxWorkers) {
+            workers = maxWorkers;
+        }
+
+        numWorkers = workers;
+        running = true;
+
+        for (int i = 1; i < numWorkers; ++i) {
+            threads[i] = std::thread(&JobSystem::workerLoop, this, i);
+        }
+
+        printf("Job system: %d workers\n", numWorkers);
+    }
+
+    void shutdown() {
+        if (!running) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            running = false;
+        }
+        wake.notify_all();
+
+        for (int i = 1; i < numWorkers; ++i) {
+            threads[i].join();
+        }
+        numWorkers = 1;
+        numExternal = 0;
+    }
+
+    // Slot of the calling thread: its deque and stats
+    static int &currentWorker() {
+        static thread_local int worker = 0;
+        return worker;
+    }
+
+    // Workers plus registered threads
+    int numSlots() {
+        return numWorkers + numExternal;
+    }
+
+    // For a thread that isn't a worker but submits and waits on jobs. It
+    // gets its own deque and stats instead of sharing the main thread's.
+    // Call on that thread, after init(), before it submits anything.
+    int registerExternalThread() {
+        int slot = numWorkers + numExternal.fetch_add(1);
+        assert(slot < numWorkers + maxExternalThreads);
+        currentWorker() = slot;
+        return slot;
+    }
+
+    void push(const Job &job) {
+        JobQueue &queue = queues[currentWorker()];
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.jobs.push_back(job);
+        }
+        queued += 1;
+
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+        }
+        wake.notify_one();
+    }
+
+    // Queue `func(data)`. If `dependency` is given the job won't start until
+    // it reaches zero.
+    void submit(JobFunc func, void *data, JobCounter *counter = NULL, JobCounter *dependency = NULL) {
+        Job job = { func, data, counter };
+
+        if (counter) {
+            counter->count += 1;
+        }
+
+        if (dependency) {
+            std::lock_guard<std::mutex> guard(dependency->lock);
+            if (dependency->count > 0) {
+                dependency->waiting.push_back(job);
+                return;
+            }
+        }
+
+        push(job);
+    }
+
+    // Newest job from our own deque, else the oldest from anyone else's.
+    // With `only` set, just jobs that count towards that counter; with
+    // `steal` false, just our own deque.
+    bool pop(int worker, Job &job, const JobCounter *only = NULL, bool steal = true) {
+        JobQueue &own = queues[worker];
+        {
+            std::lock_guard<std::mutex> guard(own.lock);
+            for (std::deque<Job>::reverse_iterator it = own.jobs.rbegin(); it != own.jobs.rend(); ++it) {
+                if (only == NULL || it->counter == only) {
+                    job = *it;
+                    own.jobs.erase(std::next(it).base());
+                    return true;
+                }
+            }
+        }
+
+        if (!steal) {
+            return false;
+        }
+
+        int slots = numSlots();
+        for (int i = 1; i < slots; ++i) {
+            JobQueue &victim = queues[(worker + i) % slots];
+
+            std::lock_guard<std::mutex> guard(victim.lock);
+            for (std::deque<Job>::iterator it = victim.jobs.begin(); it != victim.jobs.end(); ++it) {
+                if (only == NULL || it->counter == only) {
+                    job = *it;
+                    victim.jobs.erase(it);
+                    steals[worker] += 1;
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    void finish(JobCounter *counter) {
+        if (counter == NULL) {
+            return;
+        }
+
+        // Under the lock, so a waiter can't free the counter while we're still using it
+        std::vector<Job> released;
+        {
+            std::lock_guard<std::mutex> guard(counter->lock);
+            if (--counter->count == 0) {
+                released.swap(counter->waiting);
+            }
+        }
+
+        for (size_t i = 0; i < released.size(); ++i) {
+            push(released[i]);
+        }
+    }
+
+    // Runs one job if there is one (see pop()); returns false if there wasn't
+    bool runOne(int worker, const JobCounter *only = NULL, bool steal = true) {
+        Job job;
+        if (!pop(worker, job, only, steal)) {
+            return false;
+        }
+        queued -= 1;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        job.func(job.data);
+
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+        busyMicroseconds[worker] += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        jobsRun[worker] += 1;
+
+        finish(job.counter);
+
+        return true;
+    }
+
+    void workerLoop(int worker) {
+        currentWorker() = worker;
+
+        while (running) {
+            if (runOne(worker)) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait_for(guard, std::chrono::milliseconds(10), [this] { return !running || queued > 0; });
+        }
+    }
+
+    // Helps out until `counter` reaches zero. Only the counter's own jobs are
+    // run, so a wait costs about what it's waiting for rather than whatever
+    // else happens to be queued. The exception is having no workers: then
+    // the rest of our own deque (say jobs the counter's are parked behind)
+    // has nobody else to run it.
+    void wait(JobCounter &counter) {
+        int worker = currentWorker();
+
+        while (counter.count > 0) {
+            if (runOne(worker, &counter)) {
+                continue;
+            }
+            if (numWorkers == 1 && runOne(worker, NULL, false)) {
+                continue;
+            }
+            std::this_thread::yield();
+        }
+
+        // Let whoever took the count to zero let go of the lock
+        std::lock_guard<std::mutex> guard(counter.lock);
+    }
+
+    // Calls func(data, begin, end) over [0, count) in chunks of `grain` and
+    // waits for them all
+    typedef void (*RangeFunc)(void *data, int begin, int end);
+
+    struct RangeJob {
+        RangeFunc func;
+        void *data;
+        int begin;
+        int end;
+    };
+
+    static void runRange(void *data) {
+        RangeJob *range = (RangeJob *)data;
+        range->func(range->data, range->begin, range->end);
+    }
+
+    void parallelFor(int count, int grain, RangeFunc func, void *data) {
+        if (grain < 1) {
+            grain = 1;
+        }
+
+        int numJobs = (count + grain - 1) / grain;
+
+        if (numJobs <= 1 || numWorkers == 1) {
+            func(data, 0, count);
+            return;
+        }
+
+        std::vector<RangeJob> ranges(numJobs);
+        JobCounter counter;
+
+        for (int i = 0; i < numJobs; ++i) {
+            RangeJob &range = ranges[i];
+            range.func = func;
+            range.data = data;
+            range.begin = i * grain;
+            range.end = range.begin + grain < count ? range.begin + grain : count;
+
+            submit(runRange, &range, &counter);
+        }
+
+        wait(counter);
+    }
+};
+
+JobSystem jobs;
@@ -112,6 +112,56 @@ v3 v3normalize(const v3 &a) {
     return v3(a.x / length, a.y / length, a.z / length);
 }
 
+// Octahedral mapping: a unit vector to a point in the [-1, 1] square and
+// back. Spreads precision far more evenly than storing two of x, y, z.
+inline void octahedralEncode(const v3 &dir, float &u, float &v) {
+    float l1 = fabs(dir.x) + fabs(dir.y) + fabs(dir.z);
+    u = dir.x / l1;
+    v = dir.y / l1;
+    
+    if (dir.z < 0.0) {
+        float foldedU = (1.0 - fabs(v)) * (u >= 0.0 ? 1.0 : -1.0);
+        float foldedV = (1.0 - fabs(u)) * (v >= 0.0 ? 1.0 : -1.0);
+        u = foldedU;
+        v = foldedV;
+    }
+}
+
+inline v3 octahedralDecode(float u, float v) {
+    v3 dir(u, v, 1.0f - fabs(u) - fabs(v));
+    
+    if (dir.z < 0.0) {
+        float x = dir.x;
+        dir.x = (1.0 - fabs(dir.y)) * (x >= 0.0 ? 1.0 : -1.0);
+        dir.y = (1.0 - fabs(x)) * (dir.y >= 0.0 ? 1.0 : -1.0);
+    }
+    
+    return v3normalize(dir);
+}
+
+// Unit vector as three signed normalised 10 bit fields, x in the low bits
+// (GL_INT_2_10_10_10_REV). A third of a float v3, good to about 0.1 degrees.
+inline uint32_t packNormal(const v3 &n) {
+    const float axes[3] = { n.x, n.y, n.z };
+    uint32_t packed = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        float c = axes[i] < -1.0f ? -1.0f : (axes[i] > 1.0f ? 1.0f : axes[i]);
+        int field = (int)lrintf(c * 511.0f);
+        packed |= ((uint32_t)field & 0x3ff) << (10 * i);
+    }
+
+    return packed;
+}
+
+// 0..1, xorshift. Cheap and repeatable for procedural content, not for anything that matters.
+inline float randomUnit(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
 typedef float Mat4x4[16];
 
 // ----------------------------------------------------
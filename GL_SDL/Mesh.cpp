@@ -6,29 +6,99 @@
 //  Copyright © 2016 MixBit. All rights reserved.
 //
 
+#include <vector>
+
+struct Mesh;
+
+// Called when an evicted mesh is drawn again; should call setup() with the
+// mesh's data (kept on the CPU by whoever owns it)
+typedef void (*MeshRestoreFunc)(Mesh *mesh, void *owner);
+
+// One attribute of an interleaved vertex, see Mesh::setupInterleaved()
+struct MeshAttribute {
+    GLuint index;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    int offset;             // Bytes from the start of the vertex
+};
+
 struct Mesh {
     GLuint vao = 0;
     GLuint vertexBuffer[3] = {0, 0, 0};
     GLuint indexBuffer = 0;
     int numVertices = 0;
     int numIndices = 0;
+    int vertexBytes = 0;    // Interleaved meshes only
+    GLenum primitive = GL_TRIANGLE_STRIP;
     
-    void setup(int numVerts, v3 *verts, v3 *norms, v4 *colors, int numInds, ushort *indices) {
+    // Set before setup() to draw from someone else's index buffer (left
+    // alone by destroy) rather than upload our own
+    GLuint sharedIndexBuffer = 0;
+    
+    // Bytes handed to GL for each vertex buffer and the index buffer
+    long bufferBytes[4] = {0, 0, 0, 0};
+    
+    // Eviction support, see MeshCache
+    int lastDrawnFrame = 0;
+    MeshRestoreFunc restore = NULL;
+    void *restoreOwner = NULL;
+    
+    bool resident() {
+        return vao != 0;
+    }
+    
+    long residentBytes() {
+        return bufferBytes[0] + bufferBytes[1] + bufferBytes[2] + bufferBytes[3];
+    }
+    
+    void bufferData(GLenum target, int slot, long size, const void *data, GpuMemoryKind kind) {
+        glBufferData(target, size, data, GL_STATIC_DRAW);
+        gpuMemory.resize(kind, bufferBytes[slot], size);
+        bufferBytes[slot] = size;
+    }
+    
+    // Normals go up packed, see packNormal(). Free the result.
+    static uint32_t *packNormals(int count, const v3 *norms) {
+        uint32_t *packed = (uint32_t *)malloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+        for (int i = 0; i < count; ++i) {
+            packed[i] = packNormal(norms[i]);
+        }
+        return packed;
+    }
+    
+    // Separate meshes use all three vertex buffers, interleaved ones just the first
+    void createObjects(int numVertexBuffers) {
+        if (vao != 0) {
+            return;
+        }
         
-        if (vao == 0) {
-            printf("Mesh setup\n");
-            glGenVertexArrays(1, &vao);
-            CHECK_GL_ERRORS();
-            printf("VAO: %u\n", vao);
-            
-            glGenBuffers(3, vertexBuffer);
-            CHECK_GL_ERRORS();
-            printf("VBOs: %u, %u, %u\n", vertexBuffer[0], vertexBuffer[1], vertexBuffer[2]);
-            
+        // Restores come through here too, so they're counted (gpuMemory.restores) not printed
+        glGenVertexArrays(1, &vao);
+        CHECK_GL_ERRORS();
+        
+        glGenBuffers(numVertexBuffers, vertexBuffer);
+        CHECK_GL_ERRORS();
+        
+        if (sharedIndexBuffer == 0) {
             glGenBuffers(1, &indexBuffer);
             CHECK_GL_ERRORS();
-            printf("IBO: %u\n", indexBuffer);
         }
+    }
+    
+    void setupIndices(ushort *indices) {
+        if (sharedIndexBuffer != 0) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedIndexBuffer);
+        } else {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            bufferData(GL_ELEMENT_ARRAY_BUFFER, 3, numIndices * sizeof(GLushort), indices, GpuMemoryIndex);
+        }
+        CHECK_GL_ERRORS();
+    }
+    
+    void setup(int numVerts, v3 *verts, v3 *norms, v4 *colors, int numInds, ushort *indices) {
+        
+        createObjects(3);
         
         glBindVertexArray(vao);
         CHECK_GL_ERRORS();
@@ -42,29 +112,125 @@ struct Mesh {
 //        }
         
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[0]);
-        glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(v3), verts, GL_STATIC_DRAW);
+        bufferData(GL_ARRAY_BUFFER, 0, numVertices * sizeof(v3), verts, GpuMemoryVertex);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(0);
         CHECK_GL_ERRORS();
         
+        uint32_t *packed = packNormals(numVertices, norms);
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[1]);
-        glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(v3), verts, GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        bufferData(GL_ARRAY_BUFFER, 1, numVertices * sizeof(uint32_t), packed, GpuMemoryVertex);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 0, 0);
         glEnableVertexAttribArray(1);
         CHECK_GL_ERRORS();
+        free(packed);
         
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[2]);
-        glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(v4), colors, GL_STATIC_DRAW);
+        bufferData(GL_ARRAY_BUFFER, 2, numVertices * sizeof(v4), colors, GpuMemoryVertex);
         glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(2);
         CHECK_GL_ERRORS();
         
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(GLushort), indices, GL_STATIC_DRAW);
+        setupIndices(indices);
+    }
+    
+    // All the vertex data in the first buffer, `_vertexBytes` per vertex, in
+    // whatever (packed) layout the shader expects
+    void setupInterleaved(int numVerts, const void *vertexData, int _vertexBytes,
+                          const MeshAttribute *attributes, int numAttributes, int numInds, ushort *indices) {
+        
+        createObjects(1);
+        
+        glBindVertexArray(vao);
+        CHECK_GL_ERRORS();
+        
+        numVertices = numVerts;
+        numIndices = numInds;
+        vertexBytes = _vertexBytes;
+        
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[0]);
+        bufferData(GL_ARRAY_BUFFER, 0, (long)numVertices * vertexBytes, vertexData, GpuMemoryVertex);
+        
+        for (int i = 0; i < numAttributes; ++i) {
+            const MeshAttribute &attribute = attributes[i];
+            glVertexAttribPointer(attribute.index, attribute.size, attribute.type, attribute.normalized,
+                                  vertexBytes, (const GLvoid *)(long)attribute.offset);
+            glEnableVertexAttribArray(attribute.index);
+        }
+        CHECK_GL_ERRORS();
+        
+        setupIndices(indices);
+    }
+    
+    // Overwrite a run of vertices in place, leaving the rest of the buffers alone
+    void updateVertices(int first, int count, v3 *verts, v3 *norms, v4 *colors) {
+        assert(first >= 0 && first + count <= numVertices);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(v3), count * sizeof(v3), verts);
+        CHECK_GL_ERRORS();
+        
+        uint32_t *packed = packNormals(count, norms);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[1]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(uint32_t), count * sizeof(uint32_t), packed);
+        CHECK_GL_ERRORS();
+        free(packed);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[2]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(v4), count * sizeof(v4), colors);
+        CHECK_GL_ERRORS();
+    }
+    
+    // Same for an interleaved mesh
+    void updateInterleaved(int first, int count, const void *vertexData) {
+        assert(first >= 0 && first + count <= numVertices);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, (long)first * vertexBytes, (long)count * vertexBytes, vertexData);
         CHECK_GL_ERRORS();
     }
     
+    // Frees the GL objects. The mesh can be set up again afterwards.
+    void destroy() {
+        if (vao == 0) {
+            return;
+        }
+        
+        // Unused slots are 0, which GL skips
+        glDeleteBuffers(3, vertexBuffer);
+        if (indexBuffer != 0) {
+            glDeleteBuffers(1, &indexBuffer);
+        }
+        glDeleteVertexArrays(1, &vao);
+        CHECK_GL_ERRORS();
+        
+        for (int i = 0; i < 4; ++i) {
+            gpuMemory.resize(i < 3 ? GpuMemoryVertex : GpuMemoryIndex, bufferBytes[i], 0);
+            bufferBytes[i] = 0;
+        }
+        
+        vao = 0;
+        vertexBuffer[0] = vertexBuffer[1] = vertexBuffer[2] = 0;
+        indexBuffer = 0;
+    }
+    
     void draw() {
+        drawRange(0, numIndices);
+    }
+    
+    // Part of the strip or list. Strips should start on an even index to
+    // keep the winding, lists on a multiple of three.
+    void drawRange(int firstIndex, int count) {
+        if (!resident()) {
+            if (restore == NULL) {
+                return;
+            }
+            restore(this, restoreOwner);
+            gpuMemory.restores += 1;
+        }
+        
+        lastDrawnFrame = gpuMemory.frame;
+        
         glBindVertexArray(vao);
         CHECK_GL_ERRORS();
         
@@ -79,7 +245,59 @@ struct Mesh {
         glEnableVertexAttribArray(2);
         CHECK_GL_ERRORS();
         
-        glDrawElements(GL_TRIANGLE_STRIP, numIndices, GL_UNSIGNED_SHORT, 0);
+        glDrawElements(primitive, count, GL_UNSIGNED_SHORT, (const GLvoid *)(firstIndex * sizeof(ushort)));
         CHECK_GL_ERRORS();
     }
 };
+
+// Meshes that can be dropped from the GPU when we're over budget and rebuilt
+// from their owner's CPU-side data when next drawn. Least recently drawn go first.
+struct MeshCache {
+    std::vector<Mesh *> meshes;
+    
+    void add(Mesh *mesh, MeshRestoreFunc restore, void *owner) {
+        mesh->restore = restore;
+        mesh->restoreOwner = owner;
+        meshes.push_back(mesh);
+    }
+    
+    void remove(Mesh *mesh) {
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            if (meshes[i] == mesh) {
+                meshes[i] = meshes.back();
+                meshes.pop_back();
+                return;
+            }
+        }
+    }
+    
+    // Call once per frame, after rendering
+    void enforceBudget() {
+        while (gpuMemory.overBudget()) {
+            Mesh *oldest = NULL;
+            
+            for (size_t i = 0; i < meshes.size(); ++i) {
+                Mesh *mesh = meshes[i];
+                
+                // Never evict something drawn this frame, it'd just come straight back
+                if (!mesh->resident() || mesh->lastDrawnFrame >= gpuMemory.frame) {
+                    continue;
+                }
+                
+                if (oldest == NULL || mesh->lastDrawnFrame < oldest->lastDrawnFrame) {
+                    oldest = mesh;
+                }
+            }
+            
+            if (oldest == NULL) {
+                break;
+            }
+            
+            gpuMemory.evictions += 1;
+            gpuMemory.evictedBytes += oldest->residentBytes();
+            oldest->destroy();
+        }
+    }
+};
+
+MeshCache meshCache;
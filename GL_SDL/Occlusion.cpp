@@ -0,0 +1,349 @@
+//
+//  Occlusion.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Software occlusion culling.
+//
+// Coarse occluders (stand-ins that sit inside whatever they stand for) are
+// rasterised on the CPU into a small depth buffer, then the buffer is
+// reduced to a pyramid where each texel keeps the farthest depth of the
+// four below it. A box is hidden if its nearest point is behind the
+// farthest occluder over the texels it covers, so testing anything costs a
+// few texel reads at whichever level it spans two or three of.
+//
+// Depths are stored as 1 / distance along the view direction: that
+// interpolates linearly across a triangle in screen space, bigger is
+// nearer, and 0 (nothing drawn) is infinitely far away.
+//
+// Everything is in camera-relative world space, so it runs off the
+// simulation's view without waiting for the GPU.
+
+#include <algorithm>
+#include <float.h>
+#include <vector>
+
+// The view the frame will be drawn with
+struct OcclusionCamera {
+    v3 position;
+    v3 direction, right, up;
+    float xScale, yScale;       // Projection: cot(fov / 2) / aspect and cot(fov / 2)
+    float nearPlane;
+
+    void setup(const v3 &_position, const v3 &_direction, const v3 &_right, const v3 &_up,
+               float fieldOfView, float aspect, float _nearPlane) {
+        position = _position;
+        direction = _direction;
+        right = _right;
+        up = _up;
+        yScale = 1.0 / tan(0.5 * degToRad(fieldOfView));
+        xScale = yScale / aspect;
+        nearPlane = _nearPlane;
+    }
+};
+
+struct OcclusionStats {
+    int occluderTriangles;      // After clipping
+    int chunksTested;
+    int chunksOccluded;
+    int chunksOutside;          // Off screen altogether
+    double time;                // Seconds, rasterising and testing
+
+    void reset() {
+        occluderTriangles = 0;
+        chunksTested = 0;
+        chunksOccluded = 0;
+        chunksOutside = 0;
+        time = 0.0;
+    }
+};
+
+struct OcclusionBuffer {
+    static const int width = 256;
+    static const int height = 128;
+    static const int numLevels = 8;     // Down to 2x1
+
+    // Level 0 is width x height, each level after half that
+    std::vector<float> levels[numLevels];
+
+    OcclusionCamera camera;
+    OcclusionStats stats;
+
+    // Camera space point, x and y still to be divided by w
+    struct ClipPoint {
+        float x, y, w;
+    };
+
+    // Screen position in pixels and 1 / w
+    struct ScreenPoint {
+        float x, y, z;
+    };
+
+    OcclusionBuffer() {
+        for (int l = 0; l < numLevels; ++l) {
+            levels[l].assign(levelWidth(l) * levelHeight(l), 0.0f);
+        }
+        stats.reset();
+    }
+
+    static int levelWidth(int level) {
+        return width >> level;
+    }
+
+    static int levelHeight(int level) {
+        return height >> level;
+    }
+
+    void begin(const OcclusionCamera &_camera) {
+        camera = _camera;
+        std::fill(levels[0].begin(), levels[0].end(), 0.0f);
+        stats.reset();
+    }
+
+    ClipPoint toClip(const v3 &relative) {
+        ClipPoint p;
+        p.x = v3dot(relative, camera.right) * camera.xScale;
+        p.y = v3dot(relative, camera.up) * camera.yScale;
+        p.w = v3dot(relative, camera.direction);
+        return p;
+    }
+
+    ScreenPoint toScreen(const ClipPoint &p) {
+        ScreenPoint s;
+        s.x = (0.5f + 0.5f * p.x / p.w) * width;
+        s.y = (0.5f + 0.5f * p.y / p.w) * height;
+        s.z = 1.0f / p.w;
+        return s;
+    }
+
+    // Triangle with corners relative to the camera. Anything nearer than
+    // the near plane is clipped off.
+    void drawTriangle(const v3 &a, const v3 &b, const v3 &c) {
+        ClipPoint in[3] = { toClip(a), toClip(b), toClip(c) };
+
+        if (in[0].w >= camera.nearPlane && in[1].w >= camera.nearPlane && in[2].w >= camera.nearPlane) {
+            rasterise(toScreen(in[0]), toScreen(in[1]), toScreen(in[2]));
+            return;
+        }
+
+        // Clip against w = near: a triangle becomes at most a quad
+        ClipPoint out[4];
+        int numOut = 0;
+
+        for (int i = 0; i < 3; ++i) {
+            const ClipPoint &p = in[i];
+            const ClipPoint &q = in[(i + 1) % 3];
+            bool pIn = p.w >= camera.nearPlane;
+            bool qIn = q.w >= camera.nearPlane;
+
+            if (pIn) {
+                out[numOut++] = p;
+            }
+            if (pIn != qIn) {
+                float t = (camera.nearPlane - p.w) / (q.w - p.w);
+                ClipPoint cut;
+                cut.x = p.x + t * (q.x - p.x);
+                cut.y = p.y + t * (q.y - p.y);
+                cut.w = camera.nearPlane;
+                out[numOut++] = cut;
+            }
+        }
+
+        for (int i = 2; i < numOut; ++i) {
+            rasterise(toScreen(out[0]), toScreen(out[i - 1]), toScreen(out[i]));
+        }
+    }
+
+    // Fills the pixels whose centres the triangle covers, keeping the nearest depth
+    void rasterise(ScreenPoint a, const ScreenPoint &b, ScreenPoint c) {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (area == 0.0f) {
+            return;
+        }
+
+        // Either winding will do, the far side of a mountain still hides things
+        if (area < 0.0f) {
+            ScreenPoint swap = a;
+            a = c;
+            c = swap;
+            area = -area;
+        }
+
+        int minX = (int)floorf(fminf(a.x, fminf(b.x, c.x)));
+        int maxX = (int)ceilf(fmaxf(a.x, fmaxf(b.x, c.x)));
+        int minY = (int)floorf(fminf(a.y, fminf(b.y, c.y)));
+        int maxY = (int)ceilf(fmaxf(a.y, fmaxf(b.y, c.y)));
+
+        if (minX < 0) minX = 0;
+        if (minY < 0) minY = 0;
+        if (maxX > width - 1) maxX = width - 1;
+        if (maxY > height - 1) maxY = height - 1;
+
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+
+        stats.occluderTriangles += 1;
+
+        // Edge functions and depth, stepped across the box from the first pixel centre
+        float invArea = 1.0f / area;
+        float x0 = minX + 0.5f;
+        float y0 = minY + 0.5f;
+
+        float e0Row = (c.x - b.x) * (y0 - b.y) - (c.y - b.y) * (x0 - b.x);
+        float e1Row = (a.x - c.x) * (y0 - c.y) - (a.y - c.y) * (x0 - c.x);
+        float e2Row = (b.x - a.x) * (y0 - a.y) - (b.y - a.y) * (x0 - a.x);
+
+        float e0dx = -(c.y - b.y), e0dy = c.x - b.x;
+        float e1dx = -(a.y - c.y), e1dy = a.x - c.x;
+        float e2dx = -(b.y - a.y), e2dy = b.x - a.x;
+
+        float *depth = &levels[0][0];
+
+        for (int y = minY; y <= maxY; ++y) {
+            float e0 = e0Row, e1 = e1Row, e2 = e2Row;
+            float *row = depth + y * width;
+
+            for (int x = minX; x <= maxX; ++x) {
+                if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+                    float z = (e0 * a.z + e1 * b.z + e2 * c.z) * invArea;
+                    if (z > row[x]) {
+                        row[x] = z;
+                    }
+                }
+                e0 += e0dx;
+                e1 += e1dx;
+                e2 += e2dx;
+            }
+
+            e0Row += e0dy;
+            e1Row += e1dy;
+            e2Row += e2dy;
+        }
+    }
+
+    // Call once the occluders are in, before testing
+    void finish() {
+        std::vector<float> &base = levels[0];
+
+        // Occluders only count where they cover a pixel centre, so shrink
+        // them by a pixel: a box peeking through between centres stays visible
+        std::vector<float> raw(base);
+        for (int y = 0; y < height; ++y) {
+            int y0 = y > 0 ? y - 1 : y;
+            int y1 = y < height - 1 ? y + 1 : y;
+
+            for (int x = 0; x < width; ++x) {
+                int x0 = x > 0 ? x - 1 : x;
+                int x1 = x < width - 1 ? x + 1 : x;
+
+                float farthest = raw[y * width + x];
+                for (int yy = y0; yy <= y1; ++yy) {
+                    for (int xx = x0; xx <= x1; ++xx) {
+                        farthest = fminf(farthest, raw[yy * width + xx]);
+                    }
+                }
+                base[y * width + x] = farthest;
+            }
+        }
+
+        for (int l = 1; l < numLevels; ++l) {
+            const float *below = &levels[l - 1][0];
+            float *level = &levels[l][0];
+            int w = levelWidth(l);
+            int h = levelHeight(l);
+            int belowWidth = levelWidth(l - 1);
+
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    const float *quad = below + 2 * y * belowWidth + 2 * x;
+                    level[y * w + x] = fminf(fminf(quad[0], quad[1]), fminf(quad[belowWidth], quad[belowWidth + 1]));
+                }
+            }
+        }
+    }
+
+    typedef enum {
+        OcclusionVisible,
+        OcclusionHidden,
+        OcclusionOutside,
+    } Result;
+
+    // Box with corners (relative to the camera) at
+    // centre +/- axes[0] +/- axes[1] +/- axes[2]
+    Result testBox(const v3 &centre, const v3 *axes) {
+        ClipPoint corners[8];
+
+        // Corners beyond each side of the view: left, right, bottom, top, near
+        int beyond[5] = { 0, 0, 0, 0, 0 };
+        bool reachesNear = false;
+
+        for (int i = 0; i < 8; ++i) {
+            v3 corner = centre + ((i & 1) ? 1.0f : -1.0f) * axes[0] + ((i & 2) ? 1.0f : -1.0f) * axes[1]
+                        + ((i & 4) ? 1.0f : -1.0f) * axes[2];
+            ClipPoint &p = corners[i];
+            p = toClip(corner);
+
+            beyond[0] += p.x < -p.w;
+            beyond[1] += p.x > p.w;
+            beyond[2] += p.y < -p.w;
+            beyond[3] += p.y > p.w;
+            beyond[4] += p.w < camera.nearPlane;
+            reachesNear = reachesNear || p.w < camera.nearPlane;
+        }
+
+        for (int side = 0; side < 5; ++side) {
+            if (beyond[side] == 8) {
+                return OcclusionOutside;
+            }
+        }
+
+        // Partly in front of the camera, so there's no telling
+        if (reachesNear) {
+            return OcclusionVisible;
+        }
+
+        float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+        float nearest = 0.0;
+
+        for (int i = 0; i < 8; ++i) {
+            ScreenPoint s = toScreen(corners[i]);
+            minX = fminf(minX, s.x);
+            maxX = fmaxf(maxX, s.x);
+            minY = fminf(minY, s.y);
+            maxY = fmaxf(maxY, s.y);
+            nearest = fmaxf(nearest, s.z);
+        }
+
+        if (maxX < 0.0 || minX >= width || maxY < 0.0 || minY >= height) {
+            return OcclusionOutside;
+        }
+
+        int x0 = minX > 0.0 ? (int)minX : 0;
+        int x1 = maxX < width - 1 ? (int)maxX : width - 1;
+        int y0 = minY > 0.0 ? (int)minY : 0;
+        int y1 = maxY < height - 1 ? (int)maxY : height - 1;
+
+        // Coarsest level the box still spans at most two texels of each way
+        int level = 0;
+        while (level < numLevels - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+            level += 1;
+        }
+
+        const float *depth = &levels[level][0];
+        int w = levelWidth(level);
+
+        for (int y = y0 >> level; y <= (y1 >> level); ++y) {
+            for (int x = x0 >> level; x <= (x1 >> level); ++x) {
+                if (nearest >= depth[y * w + x]) {
+                    return OcclusionVisible;
+                }
+            }
+        }
+
+        return OcclusionHidden;
+    }
+};
@@ -0,0 +1,613 @@
+//
+//  Orbits.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Orbital mechanics.
+//
+// Two kinds of gravity. The few massive bodies (planet, moons) are point
+// masses summed directly, there are only a handful and they're what
+// everything mostly falls around. Anything with lots of members (the
+// asteroid belt) also feels its own members through a Barnes-Hut tree:
+// distant clumps are lumped together at their centre of mass, so it's
+// O(n log n) rather than O(n^2).
+//
+// Integrators are symplectic (kick-drift-kick leapfrog, semi-implicit
+// Euler) so energy errors stay bounded and orbits neither decay nor creep
+// outwards however long we run.
+//
+// Everything uses gravitational parameters (mu = G * mass), so G itself
+// never shows up. Units are world units and seconds.
+
+#include <chrono>
+#include <algorithm>
+
+struct GravitySource {
+    v3 position;
+    float mu;
+    float radius;           // Inside this the pull falls off towards the centre
+};
+
+struct GravitySources {
+    static const int maxSources = 16;
+
+    int count;
+    GravitySource sources[maxSources];
+
+    GravitySources() {
+        count = 0;
+    }
+
+    void add(const v3 &position, float mu, float radius) {
+        if (count >= maxSources) {
+            return;
+        }
+        sources[count].position = position;
+        sources[count].mu = mu;
+        sources[count].radius = radius;
+        count += 1;
+    }
+
+    v3 accelerationAt(const v3 &pos) const {
+        v3 acceleration(0.0f, 0.0f, 0.0f);
+
+        for (int i = 0; i < count; ++i) {
+            v3 offset = sources[i].position - pos;
+
+            // A uniform ball inside the radius, so nothing blows up at the centre
+            float r = fmax(v3length(offset), sources[i].radius);
+            acceleration = acceleration + (sources[i].mu / (r * r * r)) * offset;
+        }
+
+        return acceleration;
+    }
+};
+
+// Kick-drift-kick leapfrog, `thrust` held constant over the step
+inline void leapfrogStep(v3 &position, v3 &velocity, const v3 &thrust, const GravitySources &gravity, float dt) {
+    velocity = velocity + (0.5f * dt) * (gravity.accelerationAt(position) + thrust);
+    position = position + dt * velocity;
+    velocity = velocity + (0.5f * dt) * (gravity.accelerationAt(position) + thrust);
+}
+
+// Closest and furthest distances from the centre of the conic a body is
+// following right now. Apoapsis is negative if it's on an escape path.
+struct OrbitShape {
+    float periapsis;
+    float apoapsis;
+};
+
+inline OrbitShape osculatingOrbit(const v3 &relativePosition, const v3 &relativeVelocity, float mu) {
+    OrbitShape shape;
+
+    double r = v3length(relativePosition);
+    double energy = 0.5 * v3dot(relativeVelocity, relativeVelocity) - mu / fmax(r, 1.0e-3);
+
+    v3 h = v3cross(relativePosition, relativeVelocity);
+    double h2 = v3dot(h, h);
+    double eccentricity = sqrt(fmax(0.0, 1.0 + 2.0 * energy * h2 / ((double)mu * mu)));
+
+    if (energy >= 0.0) {
+        shape.periapsis = h2 / (mu * (1.0 + eccentricity));
+        shape.apoapsis = -1.0;
+    } else {
+        double semiMajor = -mu / (2.0 * energy);
+        shape.periapsis = semiMajor * (1.0 - eccentricity);
+        shape.apoapsis = semiMajor * (1.0 + eccentricity);
+    }
+
+    return shape;
+}
+
+// Barnes-Hut octree over a snapshot of bodies.
+//
+// Bodies are sorted along a Morton curve (3 x 10 bit keys, radix sorted) so
+// every cell is a contiguous run of them. Nodes are stored depth first: a
+// node's children follow it directly and `next` skips its whole subtree,
+// so a walk needs no stack.
+struct GravityNode {
+    float x, y, z;          // Centre of mass
+    float mu;               // Total
+    float size;             // Cell edge
+    int first;              // Bodies in this cell (sorted order)
+    int count;
+    int leaf;               // Summed body by body rather than opened
+    int next;               // First node after this subtree
+};
+
+// Bodies of a group summed together. Two SIMD registers' worth keeps more
+// square roots in flight than one.
+static const int GravityBatchSize = 8;
+
+// What one group of bodies is pulled by: single bodies and lumped cells.
+// The group's own bodies are in there too, but with softening they pull
+// on themselves with zero force, so there's nothing to skip.
+struct InteractionList {
+    std::vector<float> x, y, z, mu;
+
+    void clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+        mu.clear();
+    }
+
+    void add(float px, float py, float pz, float pmu) {
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        mu.push_back(pmu);
+    }
+};
+
+// Adds the pull of `n` list entries on a batch of bodies. The batch is the
+// inner loop so it vectorises without reordering any sums.
+static void sumPulls(int n, const float *__restrict lx, const float *__restrict ly, const float *__restrict lz,
+                     const float *__restrict lmu,
+                     const float *__restrict bx, const float *__restrict by, const float *__restrict bz,
+                     float softening2, float *__restrict sumX, float *__restrict sumY, float *__restrict sumZ) {
+    for (int j = 0; j < n; ++j) {
+        for (int b = 0; b < GravityBatchSize; ++b) {
+            float dx = lx[j] - bx[b];
+            float dy = ly[j] - by[b];
+            float dz = lz[j] - bz[b];
+            float r2 = dx * dx + dy * dy + dz * dz + softening2;
+            float k = lmu[j] / (r2 * sqrtf(r2));
+
+            sumX[b] += k * dx;
+            sumY[b] += k * dy;
+            sumZ[b] += k * dz;
+        }
+    }
+}
+
+struct GravityTree {
+    static const int leafSize = 8;
+    static const int groupSize = 32;    // Bodies sharing one walk, at most
+    static const int batchSize = GravityBatchSize;
+    static const int keyBits = 10;      // Per axis, also the deepest level
+
+    float theta;            // Opening angle: cells smaller than this (in radians) are lumped together
+    float softening;        // Stops close pairs slingshotting each other
+
+    // Bodies in key order, and where each came from
+    int count;
+    std::vector<float> x, y, z, mu;
+    std::vector<int> index;
+    std::vector<uint32_t> keys;
+
+    std::vector<uint32_t> scratchKeys;
+    std::vector<int> scratchIndex;
+
+    std::vector<GravityNode> nodes;
+    std::vector<int> groups;        // Node indices, the biggest cells of no more than groupSize
+
+    float origin[3];
+    float extent;
+
+    double buildTime;       // Seconds, last build (all its steps)
+    int buildSteps;         // continueBuild() calls the last build took
+
+    // Where a build has got to: continueBuild() picks up from here
+    typedef enum {
+        GravityBuildBounds,
+        GravityBuildKeys,
+        GravityBuildSortCount,
+        GravityBuildSortScatter,
+        GravityBuildReorder,
+        GravityBuildNodes,
+        GravityBuildDone,
+    } BuildStage;
+
+    // Bodies per step of the per-body stages, and nodes per step of the last
+    static const int buildChunk = 4096;
+
+    BuildStage buildStage;
+    int buildCursor;        // Body (or lane, for the reorder) the stage is up to
+    int sortShift;
+    int reorderLane;
+    float boundsLow[3], boundsHigh[3];
+    std::vector<int> buckets;
+    std::vector<float> sorted;
+
+    // A cell whose children are still being added, see openNode()
+    struct BuildFrame {
+        int node;
+        int first;
+        int n;
+        int depth;
+        bool grouped;
+        int start;          // First body of the next child
+        double sx, sy, sz, smu;
+    };
+    std::vector<BuildFrame> buildStack;
+
+    GravityTree() {
+        theta = 0.7;
+        softening = 1.0;
+        count = 0;
+        origin[0] = origin[1] = origin[2] = 0.0;
+        extent = 1.0;
+        buildTime = 0.0;
+        buildSteps = 0;
+        buildStage = GravityBuildDone;
+        buildCursor = 0;
+        sortShift = 0;
+        reorderLane = 0;
+    }
+
+    // Copies the bodies in, so they can carry on moving while build() runs
+    void setBodies(const float *px, const float *py, const float *pz, const float *pmu, int n) {
+        count = n;
+        x.assign(px, px + n);
+        y.assign(py, py + n);
+        z.assign(pz, pz + n);
+        mu.assign(pmu, pmu + n);
+    }
+
+    // Spreads the low 10 bits out to every third bit
+    static uint32_t spreadBits(uint32_t v) {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // Adds the cell for bodies [first, first + n). A leaf is finished there
+    // and then; anything else stays on the stack until its children are in.
+    void openNode(int first, int n, int depth, bool grouped) {
+        int node = (int)nodes.size();
+        nodes.push_back(GravityNode());
+
+        if (!grouped && n <= groupSize) {
+            groups.push_back(node);
+            grouped = true;
+        }
+
+        BuildFrame frame = { node, first, n, depth, grouped, first, 0.0, 0.0, 0.0, 0.0 };
+
+        if (n <= leafSize || depth == keyBits) {
+            for (int i = first; i < first + n; ++i) {
+                frame.sx += (double)mu[i] * x[i];
+                frame.sy += (double)mu[i] * y[i];
+                frame.sz += (double)mu[i] * z[i];
+                frame.smu += mu[i];
+            }
+            closeNode(frame, true);
+        } else {
+            buildStack.push_back(frame);
+        }
+    }
+
+    // Writes out a cell once everything under it is done, and adds it to
+    // its parent (on top of the stack, if there is one)
+    void closeNode(const BuildFrame &frame, bool leaf) {
+        GravityNode cell;
+        cell.first = frame.first;
+        cell.count = frame.n;
+        cell.size = extent / (1 << frame.depth);
+        cell.leaf = leaf ? 1 : 0;
+
+        if (frame.smu > 0.0) {
+            cell.x = frame.sx / frame.smu;
+            cell.y = frame.sy / frame.smu;
+            cell.z = frame.sz / frame.smu;
+        } else {
+            cell.x = x[frame.first];
+            cell.y = y[frame.first];
+            cell.z = z[frame.first];
+        }
+        cell.mu = frame.smu;
+        cell.next = (int)nodes.size();
+
+        nodes[frame.node] = cell;
+
+        if (!buildStack.empty()) {
+            BuildFrame &parent = buildStack.back();
+            parent.sx += (double)cell.mu * cell.x;
+            parent.sy += (double)cell.mu * cell.y;
+            parent.sz += (double)cell.mu * cell.z;
+            parent.smu += cell.mu;
+        }
+    }
+
+    // Starts a build of the bodies from setBodies(). Nothing is built until
+    // continueBuild() is called.
+    void beginBuild() {
+        nodes.clear();
+        groups.clear();
+        buildStack.clear();
+
+        buildTime = 0.0;
+        buildSteps = 0;
+        buildCursor = 0;
+        buildStage = count > 0 ? GravityBuildBounds : GravityBuildDone;
+    }
+
+    bool buildDone() const {
+        return buildStage == GravityBuildDone;
+    }
+
+    // Carries on the build for about `budget` seconds (a chunk at least),
+    // so with nobody to hand it to it can be spread over several ticks.
+    // Returns true once it's finished.
+    bool continueBuild(double budget) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+
+        while (buildStage != GravityBuildDone) {
+            buildChunkStep();
+
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= budget) {
+                break;
+            }
+        }
+
+        buildTime += elapsed;
+        buildSteps += 1;
+        return buildStage == GravityBuildDone;
+    }
+
+    // All at once, for a worker
+    void build() {
+        beginBuild();
+        continueBuild(HUGE_VAL);
+    }
+
+    // One chunk of the current stage: bounds, Morton keys, three radix
+    // passes of ten bits (count, then scatter), bodies into key order a
+    // lane at a time, then the nodes
+    void buildChunkStep() {
+        int end = buildCursor + buildChunk < count ? buildCursor + buildChunk : count;
+
+        switch (buildStage) {
+            case GravityBuildBounds: {
+                if (buildCursor == 0) {
+                    boundsLow[0] = boundsHigh[0] = x[0];
+                    boundsLow[1] = boundsHigh[1] = y[0];
+                    boundsLow[2] = boundsHigh[2] = z[0];
+                }
+
+                float *lo = boundsLow, *hi = boundsHigh;
+                for (int i = buildCursor; i < end; ++i) {
+                    lo[0] = x[i] < lo[0] ? x[i] : lo[0];
+                    hi[0] = x[i] > hi[0] ? x[i] : hi[0];
+                    lo[1] = y[i] < lo[1] ? y[i] : lo[1];
+                    hi[1] = y[i] > hi[1] ? y[i] : hi[1];
+                    lo[2] = z[i] < lo[2] ? z[i] : lo[2];
+                    hi[2] = z[i] > hi[2] ? z[i] : hi[2];
+                }
+                buildCursor = end;
+
+                if (buildCursor == count) {
+                    extent = fmax(fmax(hi[0] - lo[0], hi[1] - lo[1]), hi[2] - lo[2]) * 1.001 + 1.0e-3;
+                    for (int a = 0; a < 3; ++a) {
+                        origin[a] = lo[a];
+                    }
+
+                    keys.resize(count);
+                    index.resize(count);
+                    buildStage = GravityBuildKeys;
+                    buildCursor = 0;
+                }
+                break;
+            }
+
+            case GravityBuildKeys: {
+                float scale = (1 << keyBits) / extent;
+
+                for (int i = buildCursor; i < end; ++i) {
+                    uint32_t qx = (uint32_t)((x[i] - origin[0]) * scale);
+                    uint32_t qy = (uint32_t)((y[i] - origin[1]) * scale);
+                    uint32_t qz = (uint32_t)((z[i] - origin[2]) * scale);
+
+                    keys[i] = (spreadBits(qx) << 2) | (spreadBits(qy) << 1) | spreadBits(qz);
+                    index[i] = i;
+                }
+                buildCursor = end;
+
+                if (buildCursor == count) {
+                    scratchKeys.resize(count);
+                    scratchIndex.resize(count);
+                    buckets.resize(1 << keyBits);
+                    sortShift = 0;
+                    buildStage = GravityBuildSortCount;
+                    buildCursor = 0;
+                }
+                break;
+            }
+
+            case GravityBuildSortCount: {
+                if (buildCursor == 0) {
+                    std::fill(buckets.begin(), buckets.end(), 0);
+                }
+
+                for (int i = buildCursor; i < end; ++i) {
+                    buckets[(keys[i] >> sortShift) & 0x3ff] += 1;
+                }
+                buildCursor = end;
+
+                if (buildCursor == count) {
+                    int total = 0;
+                    for (size_t b = 0; b < buckets.size(); ++b) {
+                        int n = buckets[b];
+                        buckets[b] = total;
+                        total += n;
+                    }
+
+                    buildStage = GravityBuildSortScatter;
+                    buildCursor = 0;
+                }
+                break;
+            }
+
+            case GravityBuildSortScatter: {
+                for (int i = buildCursor; i < end; ++i) {
+                    int slot = buckets[(keys[i] >> sortShift) & 0x3ff]++;
+                    scratchKeys[slot] = keys[i];
+                    scratchIndex[slot] = index[i];
+                }
+                buildCursor = end;
+
+                if (buildCursor == count) {
+                    keys.swap(scratchKeys);
+                    index.swap(scratchIndex);
+
+                    sortShift += keyBits;
+                    buildStage = sortShift < 3 * keyBits ? GravityBuildSortCount : GravityBuildReorder;
+                    buildCursor = 0;
+                    reorderLane = 0;
+                    sorted.resize(count);
+                }
+                break;
+            }
+
+            case GravityBuildReorder: {
+                std::vector<float> *lanes[4] = { &x, &y, &z, &mu };
+                std::vector<float> &lane = *lanes[reorderLane];
+
+                for (int i = buildCursor; i < end; ++i) {
+                    sorted[i] = lane[index[i]];
+                }
+                buildCursor = end;
+
+                if (buildCursor == count) {
+                    lane.swap(sorted);
+                    reorderLane += 1;
+                    buildCursor = 0;
+
+                    if (reorderLane == 4) {
+                        openNode(0, count, 0, false);
+                        buildStage = buildStack.empty() ? GravityBuildDone : GravityBuildNodes;
+                    }
+                }
+                break;
+            }
+
+            case GravityBuildNodes: {
+                // Children are the runs sharing the next three key bits
+                for (int step = 0; step < buildChunk && !buildStack.empty(); ++step) {
+                    BuildFrame &frame = buildStack.back();
+
+                    if (frame.start < frame.first + frame.n) {
+                        int shift = 3 * (keyBits - 1 - frame.depth);
+                        int first = frame.start;
+                        int last = frame.first + frame.n;
+                        uint32_t octant = (keys[first] >> shift) & 7;
+
+                        int next = first + 1;
+                        while (next < last && ((keys[next] >> shift) & 7) == octant) {
+                            next += 1;
+                        }
+
+                        // openNode() can grow the stack, so `frame` is done with after this
+                        frame.start = next;
+                        openNode(first, next - first, frame.depth + 1, frame.grouped);
+                    } else {
+                        BuildFrame finished = frame;
+                        buildStack.pop_back();
+                        closeNode(finished, false);
+                    }
+                }
+
+                if (buildStack.empty()) {
+                    buildStage = GravityBuildDone;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    // Pull on the bodies of one group (see `groups`) from everything else,
+    // at wherever they are now. `px` etc. and `ax` etc. are indexed the way
+    // setBodies() was. The tree is walked once for the whole group: cells
+    // far enough from all of its bodies are lumped together, the rest are
+    // summed body by body.
+    void groupAccelerations(int groupNode, const float *px, const float *py, const float *pz,
+                            float *ax, float *ay, float *az, InteractionList &list) const {
+        const GravityNode &group = nodes[groupNode];
+
+        float cx = 0.0f, cy = 0.0f, cz = 0.0f;
+        for (int j = group.first; j < group.first + group.count; ++j) {
+            cx += px[index[j]];
+            cy += py[index[j]];
+            cz += pz[index[j]];
+        }
+        cx /= group.count;
+        cy /= group.count;
+        cz /= group.count;
+
+        float radius2 = 0.0f;
+        for (int j = group.first; j < group.first + group.count; ++j) {
+            float dx = px[index[j]] - cx, dy = py[index[j]] - cy, dz = pz[index[j]] - cz;
+            radius2 = fmaxf(radius2, dx * dx + dy * dy + dz * dz);
+        }
+        float radius = sqrtf(radius2);
+
+        list.clear();
+
+        // A cell is far enough if it's more than size / theta clear of the
+        // group's bounding sphere
+        const float invTheta = 1.0f / theta;
+        int i = 0;
+
+        while (i < (int)nodes.size()) {
+            const GravityNode &node = nodes[i];
+
+            float dx = node.x - cx;
+            float dy = node.y - cy;
+            float dz = node.z - cz;
+            float reach = radius + node.size * invTheta;
+
+            if (dx * dx + dy * dy + dz * dz > reach * reach) {
+                list.add(node.x, node.y, node.z, node.mu);
+                i = node.next;
+            } else if (node.leaf) {
+                for (int j = node.first; j < node.first + node.count; ++j) {
+                    list.add(x[j], y[j], z[j], mu[j]);
+                }
+                i = node.next;
+            } else {
+                // Open it up, the first child is the next node
+                i += 1;
+            }
+        }
+
+        // Then every entry against a batch of the group at a time
+        const float softening2 = softening * softening;
+        const int end = group.first + group.count;
+
+        for (int first = group.first; first < end; first += batchSize) {
+            float bx[batchSize], by[batchSize], bz[batchSize];
+            float sumX[batchSize], sumY[batchSize], sumZ[batchSize];
+
+            int batch = end - first < batchSize ? end - first : batchSize;
+
+            for (int b = 0; b < batchSize; ++b) {
+                // Spare lanes sit at the centre and are thrown away
+                bx[b] = b < batch ? px[index[first + b]] : cx;
+                by[b] = b < batch ? py[index[first + b]] : cy;
+                bz[b] = b < batch ? pz[index[first + b]] : cz;
+                sumX[b] = sumY[b] = sumZ[b] = 0.0f;
+            }
+
+            sumPulls((int)list.x.size(), &list.x[0], &list.y[0], &list.z[0], &list.mu[0],
+                     bx, by, bz, softening2, sumX, sumY, sumZ);
+
+            for (int b = 0; b < batch; ++b) {
+                ax[index[first + b]] = sumX[b];
+                ay[index[first + b]] = sumY[b];
+                az[index[first + b]] = sumZ[b];
+            }
+        }
+    }
+};
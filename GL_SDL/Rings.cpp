@@ -0,0 +1,209 @@
+//
+//  Rings.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Planetary rings: one flat annulus and a 1D texture.
+//
+// The annulus is a single strip, drawn once. RingFragment.glsl works out
+// each fragment's distance from the planet centre, looks up density and
+// colour in a texture made once from noise(), and shadows it by casting a
+// ray towards the sun at the planet sphere. So the cost is one draw call
+// whatever the ring detail and however close we get.
+
+const char *ringVertexShader = "Assets/Shaders/RingVertex.glsl";
+const char *ringFragmentShader = "Assets/Shaders/RingFragment.glsl";
+
+struct RingSettings {
+    float planetRadius;     // For the shadow
+    float innerRadius;
+    float outerRadius;
+    v3 normal;              // Of the ring plane, unit
+};
+
+// Looked up again whenever the ring program is rebuilt
+struct RingUniforms {
+    int generation;
+    GLint planetCentre;
+    GLint ringShape;
+    GLint ringNormal;
+    GLint sunDirection;
+    GLint ringTexture;
+
+    RingUniforms() {
+        generation = -1;
+    }
+
+    void refresh(ShaderManager *shaders, ShaderHandle shader) {
+        if (!shaders->changedSince(shader, generation)) {
+            return;
+        }
+
+        planetCentre = shaders->uniformLocation(shader, "planetCentre");
+        ringShape = shaders->uniformLocation(shader, "ringShape");
+        ringNormal = shaders->uniformLocation(shader, "ringNormal");
+        sunDirection = shaders->uniformLocation(shader, "sunDirection");
+        ringTexture = shaders->uniformLocation(shader, "ringTexture");
+    }
+};
+
+struct Rings {
+    static const int segments = 256;
+    static const int textureSize = 2048;
+
+    RingSettings settings;
+
+    Mesh mesh;
+    GLuint texture;
+
+    ShaderManager *shaderManager;
+    ShaderHandle shader;
+    RingUniforms uniforms;
+
+    Rings() {
+        texture = 0;
+        shaderManager = NULL;
+        shader = InvalidShader;
+    }
+
+    // Density in alpha, inner edge first. A few octaves of noise for the
+    // ringlets, a couple of clear gaps, soft edges.
+    void buildTexture() {
+        unsigned char *texels = (unsigned char *)malloc(4 * textureSize);
+
+        for (int i = 0; i < textureSize; ++i) {
+            double t = (i + 0.5) / textureSize;
+
+            double density = 0.55 + 0.25 * noise(6.0 * t, 0.5) + 0.15 * noise(40.0 * t, 1.5) + 0.1 * noise(240.0 * t, 2.5);
+
+            // Wide gap about two thirds of the way out and a narrow one near the edge
+            density *= fmin(fabs(t - 0.64) / 0.03, 1.0);
+            density *= fmin(fabs(t - 0.9) / 0.006, 1.0);
+
+            density *= fmin(t / 0.05, 1.0) * fmin((1.0 - t) / 0.02, 1.0);
+            density = fmin(fmax(density, 0.0), 1.0);
+
+            // Dusty tan to grey, a little brighter where it's thicker
+            double tint = 0.5 + 0.5 * noise(12.0 * t, 7.5);
+            double brightness = 0.75 + 0.25 * density;
+
+            unsigned char *texel = texels + 4 * i;
+            texel[0] = (unsigned char)(255.0 * brightness * (0.85 - 0.2 * tint));
+            texel[1] = (unsigned char)(255.0 * brightness * (0.76 - 0.14 * tint));
+            texel[2] = (unsigned char)(255.0 * brightness * (0.62 - 0.02 * tint));
+            texel[3] = (unsigned char)(255.0 * density);
+        }
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_1D, texture);
+        glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, textureSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        glGenerateMipmap(GL_TEXTURE_1D);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_1D, 0);
+        CHECK_GL_ERRORS();
+
+        // Plus a third for the mips
+        gpuMemory.allocate(GpuMemoryTexture, textureBytes());
+
+        free(texels);
+    }
+
+    long textureBytes() {
+        return 4 * textureSize * 4 / 3;
+    }
+
+    void buildMesh() {
+        v3 across = fabs(settings.normal.x) < 0.9 ? v3(1.0, 0.0, 0.0) : v3(0.0, 1.0, 0.0);
+        v3 x = v3normalize(v3cross(settings.normal, across));
+        v3 y = v3cross(settings.normal, x);
+
+        // Chords cut inside the circle, so push the outer edge out to cover it
+        float outer = settings.outerRadius / cos(M_PI / segments);
+
+        int numVerts = 2 * (segments + 1);
+
+        v3 *verts = (v3 *)malloc(sizeof(v3) * numVerts);
+        v3 *norms = (v3 *)malloc(sizeof(v3) * numVerts);
+        v4 *cols = (v4 *)malloc(sizeof(v4) * numVerts);
+        ushort *indices = (ushort *)malloc(sizeof(ushort) * numVerts);
+
+        for (int i = 0; i <= segments; ++i) {
+            double angle = 2.0 * M_PI * i / segments;
+            v3 dir = (float)cos(angle) * x + (float)sin(angle) * y;
+
+            verts[2 * i] = settings.innerRadius * dir;
+            verts[2 * i + 1] = outer * dir;
+
+            for (int k = 0; k < 2; ++k) {
+                norms[2 * i + k] = settings.normal;
+                cols[2 * i + k] = v4(1.0, 1.0, 1.0, 1.0);
+                indices[2 * i + k] = 2 * i + k;
+            }
+        }
+
+        mesh.setup(numVerts, verts, norms, cols, numVerts, indices);
+
+        free(verts);
+        free(norms);
+        free(cols);
+        free(indices);
+    }
+
+    void build(const RingSettings &_settings, ShaderManager *_shaderManager) {
+        settings = _settings;
+        shaderManager = _shaderManager;
+
+        buildTexture();
+        buildMesh();
+
+        shader = shaderManager->load(ringVertexShader, NULL, ringFragmentShader);
+        uniforms.refresh(shaderManager, shader);
+    }
+
+    // After the atmosphere, so the sky doesn't haze over rings in front of
+    // the planet. Depth tested against the planet but not written, both
+    // sides drawn. Leaves blending off, depth writes on, back faces culled.
+    void draw(const v3 &planetPos, const v3 &sunDirection) {
+        glUseProgram(shaderManager->program(shader));
+        uniforms.refresh(shaderManager, shader);
+
+        glUniform3f(uniforms.planetCentre, planetPos.x, planetPos.y, planetPos.z);
+        glUniform3f(uniforms.ringShape, settings.planetRadius, settings.innerRadius, settings.outerRadius);
+        glUniform3f(uniforms.ringNormal, settings.normal.x, settings.normal.y, settings.normal.z);
+        glUniform3f(uniforms.sunDirection, sunDirection.x, sunDirection.y, sunDirection.z);
+        glUniform1i(uniforms.ringTexture, 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_1D, texture);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glDisable(GL_CULL_FACE);
+
+        mesh.draw();
+
+        glEnable(GL_CULL_FACE);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        glBindTexture(GL_TEXTURE_1D, 0);
+        CHECK_GL_ERRORS();
+    }
+
+    void destroy() {
+        mesh.destroy();
+
+        if (texture != 0) {
+            glDeleteTextures(1, &texture);
+            texture = 0;
+
+            gpuMemory.release(GpuMemoryTexture, textureBytes());
+        }
+    }
+};
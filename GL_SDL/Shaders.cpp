@@ -0,0 +1,588 @@
+//
+//  Shaders.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// Programs are keyed by a hash of their sources (plus attribute bindings and
+// driver strings). If the driver supports program binaries the linked result
+// is written to the cache directory and reused on the next launch.
+//
+// A watcher thread polls the shader files and flags programs whose sources
+// have changed; update() rebuilds them on the GL thread. A failed rebuild
+// keeps the previous program so a typo doesn't take the whole view down.
+
+typedef int ShaderHandle;
+
+struct ShaderUniform {
+    char name[32];
+    GLint location;
+};
+
+// Uniform block binding points, shared by every program that declares the block
+enum {
+    UniformBindingFrameConstants = 0,
+};
+
+const ShaderHandle InvalidShader = -1;
+
+enum {
+    ShaderStageVertex,
+    ShaderStageGeometry,
+    ShaderStageFragment,
+    NumShaderStages,
+};
+
+struct ShaderProgram {
+    const char *files[NumShaderStages];
+    const ShaderAttribute *attributes;
+    int numAttributes;
+
+    GLuint program;
+    uint64_t sourceHash;
+
+    // Bumped whenever the program object is replaced, so anything caching
+    // state derived from it (uniform locations etc.) knows to refresh
+    int generation;
+
+    // Reflected at link time so nothing needs glGetUniformLocation per frame
+    static const int maxUniforms = 16;
+    int numUniforms;
+    ShaderUniform uniforms[maxUniforms];
+
+    // Owned by the watcher thread once it's running
+    time_t modified[NumShaderStages];
+};
+
+struct ShaderBinaryHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+};
+
+const uint32_t shaderBinaryMagic = 0x53484442; // 'SHDB'
+
+inline uint64_t hashBytes(uint64_t hash, const void *data, size_t length) {
+    // FNV-1a
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t hashString(uint64_t hash, const char *str) {
+    if (str) {
+        hash = hashBytes(hash, str, strlen(str));
+    }
+    // Separator so "ab" + "c" doesn't collide with "a" + "bc"
+    return hashBytes(hash, "\0", 1);
+}
+
+inline time_t fileModifiedTime(const char *file) {
+    struct stat info;
+    if (file == NULL || stat(file, &info) != 0) {
+        return 0;
+    }
+    return info.st_mtime;
+}
+
+struct ShaderManager {
+    static const int maxPrograms = 16;
+
+    int numPrograms;
+    ShaderProgram programs[maxPrograms];
+
+    const char *cacheDirectory;
+    bool binariesSupported;
+    uint64_t driverHash;
+
+    std::thread watcher;
+    std::atomic<bool> watching;
+    std::mutex pendingLock;
+    bool pending[maxPrograms];
+
+    ShaderManager() {
+        numPrograms = 0;
+        cacheDirectory = NULL;
+        binariesSupported = false;
+        driverHash = 14695981039346656037ULL;
+        watching = false;
+
+        for (int i = 0; i < maxPrograms; ++i) {
+            pending[i] = false;
+        }
+    }
+
+    // Needs a current GL context
+    void init(const char *cacheDir) {
+        cacheDirectory = cacheDir;
+
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        CHECK_GL_ERRORS();
+
+        binariesSupported = (numFormats > 0) && (cacheDirectory != NULL);
+
+        if (binariesSupported) {
+            if (mkdir(cacheDirectory, 0755) != 0 && errno != EEXIST) {
+                printf("Shader cache: unable to create %s, binaries disabled\n", cacheDirectory);
+                binariesSupported = false;
+            }
+        }
+
+        // A driver update invalidates every cached binary
+        driverHash = hashString(driverHash, (const char *)glGetString(GL_VENDOR));
+        driverHash = hashString(driverHash, (const char *)glGetString(GL_RENDERER));
+        driverHash = hashString(driverHash, (const char *)glGetString(GL_VERSION));
+
+        printf("Shader cache: %d binary formats, %s\n", numFormats, binariesSupported ? "enabled" : "disabled");
+    }
+
+    // Load all programs before calling startWatching()
+    ShaderHandle load(const char *vertexFile, const char *geometryFile, const char *fragmentFile,
+                      const ShaderAttribute *attributes = defaultShaderAttributes,
+                      int numAttributes = numDefaultShaderAttributes) {
+        assert(!watching);
+
+        if (numPrograms >= maxPrograms) {
+            printf("Shader manager: too many programs\n");
+            return InvalidShader;
+        }
+
+        ShaderHandle handle = numPrograms;
+        ShaderProgram &prog = programs[handle];
+
+        prog.files[ShaderStageVertex] = vertexFile;
+        prog.files[ShaderStageGeometry] = geometryFile;
+        prog.files[ShaderStageFragment] = fragmentFile;
+        prog.attributes = attributes;
+        prog.numAttributes = numAttributes;
+        prog.program = 0;
+        prog.sourceHash = 0;
+        prog.generation = 0;
+        prog.numUniforms = 0;
+
+        for (int stage = 0; stage < NumShaderStages; ++stage) {
+            prog.modified[stage] = fileModifiedTime(prog.files[stage]);
+        }
+
+        if (!build(prog)) {
+            printf("Shader manager: failed to build %s / %s\n", vertexFile, fragmentFile);
+            return InvalidShader;
+        }
+
+        numPrograms += 1;
+
+        return handle;
+    }
+
+    GLuint program(ShaderHandle handle) {
+        if (handle < 0 || handle >= numPrograms) {
+            return 0;
+        }
+        return programs[handle].program;
+    }
+
+    int generation(ShaderHandle handle) {
+        if (handle < 0 || handle >= numPrograms) {
+            return 0;
+        }
+        return programs[handle].generation;
+    }
+
+    // For per-frame users caching uniform locations: brings `generation` up
+    // to date and returns true if the program has been replaced since they
+    // were looked up (start `generation` at -1 so the first call does)
+    bool changedSince(ShaderHandle handle, int &generation) {
+        int current = this->generation(handle);
+        if (current == generation) {
+            return false;
+        }
+        generation = current;
+        return true;
+    }
+
+    // Cheap enough for setup code; per-frame users should cache the result
+    // and refresh it when generation() changes, see changedSince()
+    GLint uniformLocation(ShaderHandle handle, const char *name) {
+        if (handle < 0 || handle >= numPrograms) {
+            return -1;
+        }
+
+        ShaderProgram &prog = programs[handle];
+
+        for (int i = 0; i < prog.numUniforms; ++i) {
+            if (strcmp(prog.uniforms[i].name, name) == 0) {
+                return prog.uniforms[i].location;
+            }
+        }
+
+        return -1;
+    }
+
+    // Call once per frame on the GL thread
+    void update() {
+        bool rebuild[maxPrograms];
+
+        {
+            std::lock_guard<std::mutex> lock(pendingLock);
+            for (int i = 0; i < numPrograms; ++i) {
+                rebuild[i] = pending[i];
+                pending[i] = false;
+            }
+        }
+
+        for (int i = 0; i < numPrograms; ++i) {
+            if (!rebuild[i]) {
+                continue;
+            }
+
+            ShaderProgram &prog = programs[i];
+
+            if (build(prog)) {
+                printf("Shader reloaded: %s / %s (program %u)\n",
+                       prog.files[ShaderStageVertex], prog.files[ShaderStageFragment], prog.program);
+            } else {
+                printf("Shader reload failed, keeping program %u\n", prog.program);
+            }
+        }
+    }
+
+    void startWatching() {
+        if (watching) {
+            return;
+        }
+
+        watching = true;
+        watcher = std::thread(&ShaderManager::watchFiles, this);
+    }
+
+    void stopWatching() {
+        if (!watching) {
+            return;
+        }
+
+        watching = false;
+        watcher.join();
+    }
+
+    void destroy() {
+        stopWatching();
+
+        for (int i = 0; i < numPrograms; ++i) {
+            if (programs[i].program != 0) {
+                glDeleteProgram(programs[i].program);
+                programs[i].program = 0;
+            }
+        }
+        numPrograms = 0;
+    }
+
+    void watchFiles() {
+        while (watching) {
+            for (int i = 0; i < numPrograms; ++i) {
+                ShaderProgram &prog = programs[i];
+                bool changed = false;
+
+                for (int stage = 0; stage < NumShaderStages; ++stage) {
+                    if (prog.files[stage] == NULL) {
+                        continue;
+                    }
+
+                    time_t modified = fileModifiedTime(prog.files[stage]);
+
+                    // Zero means the file is mid-save (or gone) - try again next poll
+                    if (modified != 0 && modified != prog.modified[stage]) {
+                        prog.modified[stage] = modified;
+                        changed = true;
+                    }
+                }
+
+                if (changed) {
+                    std::lock_guard<std::mutex> lock(pendingLock);
+                    pending[i] = true;
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        }
+    }
+
+    void bindUniformBlock(GLuint program, const char *blockName, GLuint binding) {
+        GLuint blockIndex = glGetUniformBlockIndex(program, blockName);
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, blockIndex, binding);
+            CHECK_GL_ERRORS();
+        }
+    }
+
+    void reflect(ShaderProgram &prog) {
+        bindUniformBlock(prog.program, "FrameConstants", UniformBindingFrameConstants);
+
+        GLint numActive = 0;
+        glGetProgramiv(prog.program, GL_ACTIVE_UNIFORMS, &numActive);
+        CHECK_GL_ERRORS();
+
+        prog.numUniforms = 0;
+
+        for (GLint i = 0; i < numActive; ++i) {
+            if (prog.numUniforms >= ShaderProgram::maxUniforms) {
+                printf("Shader manager: too many uniforms in %s\n", prog.files[ShaderStageVertex]);
+                break;
+            }
+
+            ShaderUniform &uniform = prog.uniforms[prog.numUniforms];
+
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(prog.program, i, sizeof(uniform.name), &length, &size, &type, uniform.name);
+
+            // Block members have no location of their own
+            uniform.location = glGetUniformLocation(prog.program, uniform.name);
+            if (uniform.location < 0) {
+                continue;
+            }
+
+            prog.numUniforms += 1;
+        }
+        CHECK_GL_ERRORS();
+    }
+
+    uint64_t hashProgram(const ShaderProgram &prog, char *sources[NumShaderStages]) {
+        uint64_t hash = driverHash;
+
+        for (int stage = 0; stage < NumShaderStages; ++stage) {
+            hash = hashString(hash, sources[stage]);
+        }
+
+        for (int i = 0; i < prog.numAttributes; ++i) {
+            hash = hashBytes(hash, &prog.attributes[i].index, sizeof(prog.attributes[i].index));
+            hash = hashString(hash, prog.attributes[i].name);
+        }
+
+        return hash;
+    }
+
+    void cachePath(char *path, size_t pathLength, uint64_t hash) {
+        snprintf(path, pathLength, "%s/%016llx.bin", cacheDirectory, (unsigned long long)hash);
+    }
+
+    GLuint loadBinary(uint64_t hash) {
+        char path[1024];
+        cachePath(path, sizeof(path), hash);
+
+        FILE *fptr = fopen(path, "rb");
+        if (!fptr) {
+            return 0;
+        }
+
+        ShaderBinaryHeader header;
+        GLuint program = 0;
+
+        if (fread(&header, sizeof(header), 1, fptr) == 1 && header.magic == shaderBinaryMagic && header.length > 0) {
+            void *binary = malloc(header.length);
+
+            if (fread(binary, header.length, 1, fptr) == 1) {
+                program = glCreateProgram();
+                glProgramBinary(program, header.format, binary, header.length);
+
+                // Drivers are free to reject a binary, in which case we just compile from source
+                GLint isLinked = FALSE;
+                glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+                if (isLinked == FALSE) {
+                    glDeleteProgram(program);
+                    program = 0;
+                }
+
+                // Swallow any error from a rejected binary so CHECK_GL_ERRORS doesn't trip later
+                while (glGetError() != GL_NO_ERROR) {}
+            }
+
+            free(binary);
+        }
+
+        fclose(fptr);
+
+        return program;
+    }
+
+    void saveBinary(GLuint program, uint64_t hash) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        CHECK_GL_ERRORS();
+
+        if (length <= 0) {
+            return;
+        }
+
+        void *binary = malloc(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary);
+        CHECK_GL_ERRORS();
+
+        char path[1024];
+        cachePath(path, sizeof(path), hash);
+
+        FILE *fptr = fopen(path, "wb");
+        if (fptr) {
+            ShaderBinaryHeader header;
+            header.magic = shaderBinaryMagic;
+            header.format = format;
+            header.length = length;
+
+            fwrite(&header, sizeof(header), 1, fptr);
+            fwrite(binary, length, 1, fptr);
+            fclose(fptr);
+        }
+
+        free(binary);
+    }
+
+    GLuint compileProgram(const ShaderProgram &prog, char *sources[NumShaderStages]) {
+        GLuint vertexShader = compileShaderSource(sources[ShaderStageVertex], ShaderTypeVertex, prog.files[ShaderStageVertex]);
+        GLuint geometryShader = 0;
+        GLuint fragmentShader = compileShaderSource(sources[ShaderStageFragment], ShaderTypeFragment, prog.files[ShaderStageFragment]);
+
+        if (sources[ShaderStageGeometry]) {
+            geometryShader = compileShaderSource(sources[ShaderStageGeometry], ShaderTypeGeometry, prog.files[ShaderStageGeometry]);
+        }
+
+        GLuint program = 0;
+
+        bool geometryOk = (sources[ShaderStageGeometry] == NULL) || (geometryShader != 0);
+
+        if (vertexShader != 0 && fragmentShader != 0 && geometryOk) {
+            // So a failed reload says which program broke
+            char name[256];
+            snprintf(name, sizeof(name), "%s + %s", prog.files[ShaderStageVertex], prog.files[ShaderStageFragment]);
+
+            program = linkShaders(vertexShader, geometryShader, fragmentShader, name,
+                                  prog.attributes, prog.numAttributes, binariesSupported);
+        }
+
+        // The program keeps what it needs once linked
+        if (vertexShader) glDeleteShader(vertexShader);
+        if (geometryShader) glDeleteShader(geometryShader);
+        if (fragmentShader) glDeleteShader(fragmentShader);
+
+        return program;
+    }
+
+    bool build(ShaderProgram &prog) {
+        char *sources[NumShaderStages];
+        bool sourcesOk = true;
+
+        for (int stage = 0; stage < NumShaderStages; ++stage) {
+            sources[stage] = NULL;
+
+            if (prog.files[stage]) {
+                sources[stage] = fileToCharArray(prog.files[stage]);
+
+                if (!sources[stage]) {
+                    printf("Error reading shader: %s\n", prog.files[stage]);
+                    sourcesOk = false;
+                }
+            }
+        }
+
+        GLuint program = 0;
+        uint64_t hash = 0;
+
+        if (sourcesOk) {
+            hash = hashProgram(prog, sources);
+
+            if (prog.program != 0 && hash == prog.sourceHash) {
+                // Touched but not changed
+                program = prog.program;
+            } else {
+                if (binariesSupported) {
+                    program = loadBinary(hash);
+                }
+
+                if (program == 0) {
+                    program = compileProgram(prog, sources);
+
+                    if (program != 0 && binariesSupported) {
+                        saveBinary(program, hash);
+                    }
+                }
+            }
+        }
+
+        for (int stage = 0; stage < NumShaderStages; ++stage) {
+            free(sources[stage]);
+        }
+
+        if (program == 0) {
+            return false;
+        }
+
+        if (program != prog.program) {
+            if (prog.program != 0) {
+                glDeleteProgram(prog.program);
+            }
+
+            prog.program = program;
+            prog.sourceHash = hash;
+            prog.generation += 1;
+
+            reflect(prog);
+        }
+
+        return true;
+    }
+};
+
+// Per-frame data shared by every program via the FrameConstants block.
+// Layout must match std140 in the shaders (mat4 = 4 x vec4, vec4 aligned to 16).
+struct FrameConstants {
+    Mat4x4 viewMatrix;
+    Mat4x4 projectionMatrix;
+    Mat4x4 viewProjectionMatrix;
+    float cameraPosition[4];
+    float time;
+    float padding[3];
+};
+
+struct FrameConstantsBuffer {
+    GLuint buffer = 0;
+
+    void init() {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, UniformBindingFrameConstants, buffer);
+        CHECK_GL_ERRORS();
+
+        gpuMemory.allocate(GpuMemoryUniform, sizeof(FrameConstants));
+    }
+
+    void update(const FrameConstants &constants) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        // Orphan first so we don't wait on last frame's draws still reading it
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameConstants), &constants);
+        CHECK_GL_ERRORS();
+    }
+
+    void destroy() {
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+
+            gpuMemory.release(GpuMemoryUniform, sizeof(FrameConstants));
+        }
+    }
+};
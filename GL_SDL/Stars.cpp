@@ -0,0 +1,471 @@
+//
+//  Stars.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Star field, drawn as points at infinity behind everything else.
+//
+// Stars come from a compact binary catalog sorted brightest first, which
+// turns the star budget into a magnitude: if we can afford N stars, the
+// faintest we draw is the Nth one in the file.
+//
+// At load the stars are bucketed into cells on a cube around the sky,
+// keeping each cell brightest first. Each frame, for every cell in the view
+// cone, we draw the part of that cell brighter than the limit. All of these
+// go out in a single glMultiDrawArrays. Decoding and shading happen in
+// StarVertex.glsl / StarFragment.glsl.
+//
+// Without a catalog on disk a synthetic one is generated and saved, so a
+// real one (converted to the same format) can just be dropped in.
+
+#include <stdint.h>
+
+const char *starVertexShader = "Assets/Shaders/StarVertex.glsl";
+const char *starFragmentShader = "Assets/Shaders/StarFragment.glsl";
+
+// Catalog file: a StarCatalogHeader, then `count` StarRecords, brightest first
+struct StarCatalogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t recordSize;
+};
+
+const uint32_t starCatalogMagic = 0x53544152; // 'STAR'
+const uint32_t starCatalogVersion = 1;
+
+// Goes straight into the vertex buffer, 8 bytes a star
+struct StarRecord {
+    int16_t direction[2];   // Octahedral, -32767..32767 for -1..1
+    int16_t magnitude;      // Apparent magnitude, thousandths
+    int16_t colour;         // B-V colour index, thousandths
+};
+
+const ShaderAttribute starShaderAttributes[] = {
+    {0, "in_Direction"},
+    {1, "in_Magnitude"},
+};
+const int numStarShaderAttributes = sizeof(starShaderAttributes) / sizeof(starShaderAttributes[0]);
+
+struct StarCatalog {
+    int count;
+    StarRecord *records;
+};
+
+inline float starMagnitude(const StarRecord &record) {
+    return record.magnitude * 0.001f;
+}
+
+inline v3 starDirection(const StarRecord &record) {
+    return octahedralDecode(record.direction[0] / 32767.0f, record.direction[1] / 32767.0f);
+}
+
+int compareStarMagnitudes(const void *a, const void *b) {
+    return ((const StarRecord *)a)->magnitude - ((const StarRecord *)b)->magnitude;
+}
+
+bool loadStarCatalog(const char *path, StarCatalog &catalog) {
+    catalog.count = 0;
+    catalog.records = NULL;
+
+    FILE *fptr = fopen(path, "rb");
+    if (!fptr) {
+        return false;
+    }
+
+    StarCatalogHeader header;
+    bool loaded = false;
+
+    if (fread(&header, sizeof(header), 1, fptr) == 1 && header.magic == starCatalogMagic &&
+        header.version == starCatalogVersion && header.recordSize == sizeof(StarRecord)) {
+
+        catalog.records = (StarRecord *)malloc(sizeof(StarRecord) * header.count);
+
+        if (fread(catalog.records, sizeof(StarRecord), header.count, fptr) == header.count) {
+            catalog.count = header.count;
+            loaded = true;
+        } else {
+            free(catalog.records);
+            catalog.records = NULL;
+        }
+    }
+
+    fclose(fptr);
+
+    if (!loaded) {
+        printf("Stars: %s isn't a star catalog\n", path);
+    }
+
+    return loaded;
+}
+
+bool saveStarCatalog(const char *path, const StarCatalog &catalog) {
+    FILE *fptr = fopen(path, "wb");
+    if (!fptr) {
+        return false;
+    }
+
+    StarCatalogHeader header;
+    header.magic = starCatalogMagic;
+    header.version = starCatalogVersion;
+    header.count = catalog.count;
+    header.recordSize = sizeof(StarRecord);
+
+    fwrite(&header, sizeof(header), 1, fptr);
+    fwrite(catalog.records, sizeof(StarRecord), catalog.count, fptr);
+    fclose(fptr);
+
+    return true;
+}
+
+// Roughly the real sky: star counts go up ~2.75x per magnitude, a good share
+// of them crowd a tilted galactic plane, and most are a little redder than white
+void generateStarCatalog(StarCatalog &catalog, int count, float faintest, uint32_t seed) {
+    catalog.count = count;
+    catalog.records = (StarRecord *)malloc(sizeof(StarRecord) * count);
+
+    uint32_t state = seed ? seed : 1;
+
+    v3 galacticPole = v3normalize(v3(0.3, -0.5, 0.8));
+    v3 galacticX = v3normalize(v3cross(galacticPole, v3(1.0, 0.0, 0.0)));
+    v3 galacticY = v3cross(galacticPole, galacticX);
+
+    for (int i = 0; i < count; ++i) {
+        StarRecord &record = catalog.records[i];
+
+        float magnitude = faintest + log10(fmax(randomUnit(state), 1.0e-7f)) / 0.44;
+        magnitude = fmax(magnitude, -1.5f);
+
+        float longitude = 2.0 * M_PI * randomUnit(state);
+        float sinLatitude = 2.0 * randomUnit(state) - 1.0;
+
+        if (randomUnit(state) < 0.4) {
+            // Box-Muller, about 10 degrees either side of the plane
+            float gaussian = sqrt(-2.0 * log(fmax(randomUnit(state), 1.0e-7f))) * cos(2.0 * M_PI * randomUnit(state));
+            sinLatitude = sin(fmin(fmax(0.17f * gaussian, -1.5f), 1.5f));
+        }
+
+        float cosLatitude = sqrt(fmax(1.0f - sinLatitude * sinLatitude, 0.0f));
+        v3 dir = (cosLatitude * cos(longitude)) * galacticX + (cosLatitude * sin(longitude)) * galacticY
+                 + sinLatitude * galacticPole;
+
+        float u, v;
+        octahedralEncode(dir, u, v);
+
+        float colour = 0.6 + 0.8 * (randomUnit(state) + randomUnit(state) - 1.0);
+
+        record.direction[0] = (int16_t)lrint(u * 32767.0);
+        record.direction[1] = (int16_t)lrint(v * 32767.0);
+        record.magnitude = (int16_t)lrint(magnitude * 1000.0);
+        record.colour = (int16_t)lrint(fmin(fmax(colour, -0.4f), 2.0f) * 1000.0);
+    }
+
+    qsort(catalog.records, count, sizeof(StarRecord), compareStarMagnitudes);
+}
+
+struct Stars {
+    // Sky cells, on a cube the same way round as the terrain
+    static const int cellsPerSide = 8;
+    static const int numCells = 6 * cellsPerSide * cellsPerSide;
+
+    int numStars;
+
+    // Buffer order (by cell, brightest first within each)
+    float *magnitudes;
+
+    // Catalog order, so budget -> magnitude is a lookup
+    float *catalogMagnitudes;
+
+    GLint cellFirst[numCells];
+    GLsizei cellCount[numCells];
+    v3 cellCentre[numCells];
+    float cellRadius[numCells];     // Angle from the centre to the furthest corner
+
+    // What to draw: up to `budget` stars, none fainter than `magnitudeLimit`
+    int budget;
+    float magnitudeLimit;
+
+    GLuint vao;
+    GLuint vbo;
+    long bufferBytes;
+
+    ShaderManager *shaderManager;
+    ShaderHandle shader;
+    int shaderGeneration;           // Of the program limitUniform came from
+    GLint limitUniform;
+
+    GLint drawFirst[numCells];
+    GLsizei drawCount[numCells];
+
+    // Stats, reset by the caller
+    long starsDrawn;
+    int cellsDrawn;
+    float drawnLimit;
+
+    Stars() {
+        numStars = 0;
+        magnitudes = NULL;
+        catalogMagnitudes = NULL;
+
+        budget = 250000;
+        magnitudeLimit = 9.0;
+
+        vao = 0;
+        vbo = 0;
+        bufferBytes = 0;
+
+        shaderManager = NULL;
+        shader = InvalidShader;
+        shaderGeneration = -1;
+        limitUniform = -1;
+
+        starsDrawn = 0;
+        cellsDrawn = 0;
+        drawnLimit = 0.0;
+    }
+
+    // Again only after a hot reload
+    void findUniforms() {
+        if (shaderManager->changedSince(shader, shaderGeneration)) {
+            limitUniform = shaderManager->uniformLocation(shader, "magnitudeLimit");
+        }
+    }
+
+    // Unit direction for (u, v) in -1..1 on cube face `face` (+x, -x, +y, -y, +z, -z)
+    static v3 cellDirection(int face, float u, float v) {
+        int axis = face / 2;
+        float point[3];
+        point[axis] = (face & 1) ? -1.0 : 1.0;
+        point[(axis + 1) % 3] = u;
+        point[(axis + 2) % 3] = v;
+        return v3normalize(v3(point));
+    }
+
+    static int cellIndex(const v3 &dir) {
+        int axis = 0;
+        if (fabs(dir.v[1]) > fabs(dir.v[axis])) axis = 1;
+        if (fabs(dir.v[2]) > fabs(dir.v[axis])) axis = 2;
+
+        int face = 2 * axis + (dir.v[axis] < 0.0 ? 1 : 0);
+        float major = fabs(dir.v[axis]);
+
+        int i = (int)((dir.v[(axis + 1) % 3] / major + 1.0) * 0.5 * cellsPerSide);
+        int j = (int)((dir.v[(axis + 2) % 3] / major + 1.0) * 0.5 * cellsPerSide);
+        i = i < 0 ? 0 : (i >= cellsPerSide ? cellsPerSide - 1 : i);
+        j = j < 0 ? 0 : (j >= cellsPerSide ? cellsPerSide - 1 : j);
+
+        return (face * cellsPerSide + j) * cellsPerSide + i;
+    }
+
+    void buildCells() {
+        float step = 2.0 / cellsPerSide;
+
+        for (int face = 0; face < 6; ++face) {
+            for (int j = 0; j < cellsPerSide; ++j) {
+                for (int i = 0; i < cellsPerSide; ++i) {
+                    int cell = (face * cellsPerSide + j) * cellsPerSide + i;
+                    float u = -1.0 + i * step;
+                    float v = -1.0 + j * step;
+
+                    cellCentre[cell] = cellDirection(face, u + 0.5 * step, v + 0.5 * step);
+
+                    float radius = 0.0;
+                    for (int corner = 0; corner < 4; ++corner) {
+                        v3 pt = cellDirection(face, u + (corner & 1) * step, v + (corner >> 1) * step);
+                        radius = fmax(radius, acos(fmin(v3dot(pt, cellCentre[cell]), 1.0f)));
+                    }
+                    cellRadius[cell] = radius;
+                }
+            }
+        }
+    }
+
+    bool init(const char *catalogPath, ShaderManager *_shaderManager) {
+        shaderManager = _shaderManager;
+
+        StarCatalog catalog;
+        if (!loadStarCatalog(catalogPath, catalog)) {
+            generateStarCatalog(catalog, 300000, 10.0, 0x5eed);
+            if (saveStarCatalog(catalogPath, catalog)) {
+                printf("Stars: generated %s\n", catalogPath);
+            }
+        }
+
+        numStars = catalog.count;
+
+        buildCells();
+
+        // Stable counting sort into cells, so each cell stays brightest first
+        int *cells = (int *)malloc(sizeof(int) * numStars);
+        for (int cell = 0; cell < numCells; ++cell) {
+            cellCount[cell] = 0;
+        }
+        for (int i = 0; i < numStars; ++i) {
+            cells[i] = cellIndex(starDirection(catalog.records[i]));
+            cellCount[cells[i]] += 1;
+        }
+
+        GLint first = 0;
+        for (int cell = 0; cell < numCells; ++cell) {
+            cellFirst[cell] = first;
+            first += cellCount[cell];
+        }
+
+        StarRecord *records = (StarRecord *)malloc(sizeof(StarRecord) * numStars);
+        GLint *next = (GLint *)malloc(sizeof(GLint) * numCells);
+        memcpy(next, cellFirst, sizeof(GLint) * numCells);
+
+        magnitudes = (float *)malloc(sizeof(float) * numStars);
+        catalogMagnitudes = (float *)malloc(sizeof(float) * numStars);
+
+        for (int i = 0; i < numStars; ++i) {
+            int slot = next[cells[i]]++;
+            records[slot] = catalog.records[i];
+            magnitudes[slot] = starMagnitude(catalog.records[i]);
+            catalogMagnitudes[i] = starMagnitude(catalog.records[i]);
+        }
+
+        free(next);
+        free(cells);
+        free(catalog.records);
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        bufferBytes = sizeof(StarRecord) * numStars;
+        glBufferData(GL_ARRAY_BUFFER, bufferBytes, records, GL_STATIC_DRAW);
+        gpuMemory.allocate(GpuMemoryVertex, bufferBytes);
+
+        glVertexAttribPointer(0, 2, GL_SHORT, GL_TRUE, sizeof(StarRecord), (void *)offsetof(StarRecord, direction));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(StarRecord), (void *)offsetof(StarRecord, magnitude));
+        glEnableVertexAttribArray(1);
+
+        glBindVertexArray(0);
+        CHECK_GL_ERRORS();
+
+        free(records);
+
+        shader = shaderManager->load(starVertexShader, NULL, starFragmentShader,
+                                     starShaderAttributes, numStarShaderAttributes);
+        findUniforms();
+
+        printf("Stars: %d (%.1fMB), magnitude %.2f to %.2f\n", numStars, bufferBytes / 1048576.0,
+               numStars > 0 ? catalogMagnitudes[0] : 0.0, numStars > 0 ? catalogMagnitudes[numStars - 1] : 0.0);
+
+        return numStars > 0;
+    }
+
+    // Faintest magnitude we'll draw this frame
+    float effectiveLimit() {
+        float limit = magnitudeLimit;
+        if (budget <= 0) {
+            return -100.0;
+        }
+        if (budget < numStars) {
+            limit = fmin(limit, catalogMagnitudes[budget - 1]);
+        }
+        return limit;
+    }
+
+    // Stars in `cell` no fainter than `limit`, which are all at its start
+    int cellStarsBrighterThan(int cell, float limit) {
+        int low = cellFirst[cell];
+        int high = cellFirst[cell] + cellCount[cell];
+
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (magnitudes[mid] <= limit) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        return low - cellFirst[cell];
+    }
+
+    // Draw first thing after the clear. Leaves blending off and the depth test on.
+    void draw(const v3 &viewDirection, float fieldOfView, float aspect) {
+        float limit = effectiveLimit();
+
+        // Half angle of the cone around the view frustum's corners
+        float viewAngle = atan(tan(0.5 * degToRad(fieldOfView)) * sqrt(1.0 + aspect * aspect));
+
+        int numDraws = 0;
+
+        for (int cell = 0; cell < numCells; ++cell) {
+            if (cellCount[cell] == 0) {
+                continue;
+            }
+
+            float angle = acos(fmax(fmin(v3dot(cellCentre[cell], viewDirection), 1.0f), -1.0f));
+            if (angle > viewAngle + cellRadius[cell]) {
+                continue;
+            }
+
+            int count = cellStarsBrighterThan(cell, limit);
+            if (count == 0) {
+                continue;
+            }
+
+            drawFirst[numDraws] = cellFirst[cell];
+            drawCount[numDraws] = count;
+            numDraws += 1;
+
+            starsDrawn += count;
+        }
+
+        cellsDrawn += numDraws;
+        drawnLimit = limit;
+
+        if (numDraws == 0) {
+            return;
+        }
+
+        glUseProgram(shaderManager->program(shader));
+        findUniforms();
+        glUniform1f(limitUniform, limit);
+
+        // Additive, and never in front of anything
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_PROGRAM_POINT_SIZE);
+
+        glBindVertexArray(vao);
+        glMultiDrawArrays(GL_POINTS, drawFirst, drawCount, numDraws);
+        glBindVertexArray(0);
+
+        glDisable(GL_PROGRAM_POINT_SIZE);
+        glDisable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_DEPTH_TEST);
+        CHECK_GL_ERRORS();
+    }
+
+    void destroy() {
+        if (vbo != 0) {
+            glDeleteBuffers(1, &vbo);
+            vbo = 0;
+            gpuMemory.release(GpuMemoryVertex, bufferBytes);
+            bufferBytes = 0;
+        }
+
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+            vao = 0;
+        }
+
+        free(magnitudes);
+        free(catalogMagnitudes);
+        magnitudes = NULL;
+        catalogMagnitudes = NULL;
+        numStars = 0;
+    }
+};
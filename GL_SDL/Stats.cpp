@@ -0,0 +1,393 @@
+//
+//  Stats.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Counters gathered over a reporting interval and dumped to the console.
+// Anything that wants to show up in the diagnostics adds a field here,
+// bumps it during the frame and prints it in report().
+
+struct FrameStats {
+    FrameStats() {
+        reportInterval = 1.0;
+        intervalStart = 0.0;
+
+        gpuBytes = 0;
+        gpuPeakBytes = 0;
+        gpuBudget = 0;
+
+        totalClampedFrames = 0;
+        totalClampedSimTime = 0.0;
+        totalBacklogFrames = 0;
+        totalBacklogSimTime = 0.0;
+
+        reset(0.0);
+    }
+
+    double reportInterval;
+    double intervalStart;
+
+    int frames;
+
+    // Fixed step simulation
+    int simTicks;
+    int maxTicksInFrame;
+    int clampedFrames;          // Frames over maxFrameTime, and the time cut off them
+    double clampedSimTime;
+    int backlogFrames;          // Frames that ran out of ticks, and the time they dropped
+    double backlogSimTime;
+    double simTime;
+    double realTime;
+    double updateTime;
+
+    int totalClampedFrames;
+    double totalClampedSimTime;
+    int totalBacklogFrames;
+    double totalBacklogSimTime;
+
+    // GPU buffer memory (sampled at report time)
+    long gpuBytes;
+    long gpuPeakBytes;
+    long gpuBudget;
+    int meshEvictions;
+    int meshRestores;
+    long evictedBytes;
+
+    // Streaming vertex data
+    long streamBytes;
+    int streamFenceStalls;
+    int streamOverflows;
+
+    // Atmosphere fill (samples are read back a few frames late)
+    bool atmosphereInside;
+    int atmosphereDrawCalls;
+    long atmosphereTriangles;
+    long atmosphereSamples;
+    long screenSamples;
+
+    // Celestial bodies
+    int bodies;
+    int bodiesDetailed;
+    int bodyImpostors;
+    int bodiesGenerating;
+
+    // Terrain chunk culling (the occlusion pass is simulation side)
+    long terrainTriangles;
+    long terrainTrianglesCulled;
+    long occluderTriangles;
+    long chunksTested;
+    long chunksOccluded;
+    long chunksOutside;
+    double occlusionTime;
+
+    // Star field
+    long starsDrawn;
+    int starCells;
+    float starLimit;
+
+    // Asteroid field (step time is simulation side)
+    int asteroids;
+    double asteroidStepTime;
+    double asteroidStepBudget;
+    long asteroidsDrawn[3];         // By level of detail
+    int asteroidsDropped;
+
+    // Rock on rock gravity (sampled)
+    int gravityTreeNodes;
+    double gravityTreeBuildTime;
+    int gravityTreeBuildTicks;
+    int gravityRefreshSlice;
+    double gravitySweepTime;
+
+    // Ship's orbit (sampled)
+    bool shipOrbital;
+    const char *shipBody;
+    float shipAltitude;
+    float shipSpeed;
+    float shipPeriapsis;
+    float shipApoapsis;
+
+    // Job system, per worker (0 is the main thread)
+    static const int maxJobWorkers = JobSystem::maxSlots;
+    int jobWorkers;
+    long jobBusyMicroseconds[maxJobWorkers];
+    int jobsRun;
+    int jobSteals;
+
+    void reset(double now) {
+        intervalStart = now;
+
+        frames = 0;
+
+        simTicks = 0;
+        maxTicksInFrame = 0;
+        clampedFrames = 0;
+        clampedSimTime = 0.0;
+        backlogFrames = 0;
+        backlogSimTime = 0.0;
+        simTime = 0.0;
+        realTime = 0.0;
+        updateTime = 0.0;
+
+        meshEvictions = 0;
+        meshRestores = 0;
+        evictedBytes = 0;
+
+        streamBytes = 0;
+        streamFenceStalls = 0;
+        streamOverflows = 0;
+
+        atmosphereInside = false;
+        atmosphereDrawCalls = 0;
+        atmosphereTriangles = 0;
+        atmosphereSamples = 0;
+        screenSamples = 0;
+
+        bodies = 0;
+        bodiesDetailed = 0;
+        bodyImpostors = 0;
+        bodiesGenerating = 0;
+
+        terrainTriangles = 0;
+        terrainTrianglesCulled = 0;
+        occluderTriangles = 0;
+        chunksTested = 0;
+        chunksOccluded = 0;
+        chunksOutside = 0;
+        occlusionTime = 0.0;
+
+        starsDrawn = 0;
+        starCells = 0;
+        starLimit = 0.0;
+
+        asteroids = 0;
+        asteroidStepTime = 0.0;
+        asteroidStepBudget = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            asteroidsDrawn[i] = 0;
+        }
+        asteroidsDropped = 0;
+
+        gravityTreeNodes = 0;
+        gravityTreeBuildTime = 0.0;
+        gravityTreeBuildTicks = 0;
+        gravityRefreshSlice = 0;
+        gravitySweepTime = 0.0;
+
+        shipOrbital = false;
+        shipBody = "";
+        shipAltitude = 0.0;
+        shipSpeed = 0.0;
+        shipPeriapsis = 0.0;
+        shipApoapsis = 0.0;
+
+        jobWorkers = 0;
+        for (int i = 0; i < maxJobWorkers; ++i) {
+            jobBusyMicroseconds[i] = 0;
+        }
+        jobsRun = 0;
+        jobSteals = 0;
+    }
+
+    void recordSimulation(int ticks, double dt, double frameTime, double tickTime, double clamped, double backlog) {
+        frames += 1;
+
+        simTicks += ticks;
+        if (ticks > maxTicksInFrame) {
+            maxTicksInFrame = ticks;
+        }
+
+        simTime += ticks * dt;
+        realTime += frameTime;
+        updateTime += tickTime;
+
+        if (clamped > 0.0) {
+            clampedFrames += 1;
+            clampedSimTime += clamped;
+
+            totalClampedFrames += 1;
+            totalClampedSimTime += clamped;
+        }
+
+        if (backlog > 0.0) {
+            backlogFrames += 1;
+            backlogSimTime += backlog;
+
+            totalBacklogFrames += 1;
+            totalBacklogSimTime += backlog;
+        }
+    }
+
+    void recordStream(long bytes, int fenceStalls, int overflows) {
+        streamBytes += bytes;
+        streamFenceStalls += fenceStalls;
+        streamOverflows += overflows;
+    }
+
+    void recordAtmosphere(bool inside, int drawCalls, long triangles, long samples, long frameSamples) {
+        atmosphereInside = inside;
+        atmosphereDrawCalls += drawCalls;
+        atmosphereTriangles += triangles;
+        atmosphereSamples += samples;
+        screenSamples += frameSamples;
+    }
+
+    void recordBodies(int count, int detailed, int impostors, int generating) {
+        bodies = count;
+        bodiesDetailed += detailed;
+        bodyImpostors += impostors;
+        bodiesGenerating = generating;
+    }
+
+    void recordTerrainTriangles(long drawn, long culled) {
+        terrainTriangles += drawn;
+        terrainTrianglesCulled += culled;
+    }
+
+    void recordOcclusion(int occluders, int tested, int occluded, int outside, double time) {
+        occluderTriangles += occluders;
+        chunksTested += tested;
+        chunksOccluded += occluded;
+        chunksOutside += outside;
+        occlusionTime += time;
+    }
+
+    void recordStars(long drawn, int cells, float limit) {
+        starsDrawn += drawn;
+        starCells += cells;
+        starLimit = limit;
+    }
+
+    void recordAsteroidSteps(int count, double stepTime, double budget) {
+        asteroids = count;
+        asteroidStepTime += stepTime;
+        asteroidStepBudget = budget;
+    }
+
+    void recordAsteroidsDrawn(long level0, long level1, long level2, int dropped) {
+        asteroidsDrawn[0] += level0;
+        asteroidsDrawn[1] += level1;
+        asteroidsDrawn[2] += level2;
+        asteroidsDropped += dropped;
+    }
+
+    void recordAsteroidGravity(int treeNodes, double treeBuildTime, int treeBuildTicks, int refreshSlice, double sweepTime) {
+        gravityTreeNodes = treeNodes;
+        gravityTreeBuildTime = treeBuildTime;
+        gravityTreeBuildTicks = treeBuildTicks;
+        gravityRefreshSlice = refreshSlice;
+        gravitySweepTime = sweepTime;
+    }
+
+    void recordShip(bool orbital, const char *body, float altitude, float speed, float periapsis, float apoapsis) {
+        shipOrbital = orbital;
+        shipBody = body;
+        shipAltitude = altitude;
+        shipSpeed = speed;
+        shipPeriapsis = periapsis;
+        shipApoapsis = apoapsis;
+    }
+
+    void recordJobs(int worker, long busyMicroseconds, int jobs, int steals) {
+        if (worker >= maxJobWorkers) {
+            return;
+        }
+        if (worker >= jobWorkers) {
+            jobWorkers = worker + 1;
+        }
+        jobBusyMicroseconds[worker] += busyMicroseconds;
+        jobsRun += jobs;
+        jobSteals += steals;
+    }
+
+    void recordGpuMemory(long bytes, long peakBytes, long budget, int evictions, int restores, long evicted) {
+        gpuBytes = bytes;
+        gpuPeakBytes = peakBytes;
+        gpuBudget = budget;
+        meshEvictions += evictions;
+        meshRestores += restores;
+        evictedBytes += evicted;
+    }
+
+    // Ratio of simulated to real time, 1.0 when we're keeping up
+    double timeDilation() {
+        if (realTime <= 0.0) {
+            return 1.0;
+        }
+        return simTime / realTime;
+    }
+
+    void report(double now) {
+        double elapsed = now - intervalStart;
+
+        if (elapsed < reportInterval) {
+            return;
+        }
+
+        printf("Frames: %d (%.1f fps)\n", frames, frames / elapsed);
+        printf("  Sim: %d ticks (max %d/frame), update %.2fms/frame, dilation %.3f\n",
+               simTicks, maxTicksInFrame, frames > 0 ? 1000.0 * updateTime / frames : 0.0, timeDilation());
+        printf("  Clamped: %d frames, cut %.3fs (total %d frames, %.3fs)\n",
+               clampedFrames, clampedSimTime, totalClampedFrames, totalClampedSimTime);
+        printf("  Backlog: %d frames, dropped %.3fs (total %d frames, %.3fs)\n",
+               backlogFrames, backlogSimTime, totalBacklogFrames, totalBacklogSimTime);
+        printf("  GPU memory: %.1fMB of %.1fMB (peak %.1fMB), %d evictions (%.1fMB), %d restores\n",
+               gpuBytes / 1048576.0, gpuBudget / 1048576.0, gpuPeakBytes / 1048576.0,
+               meshEvictions, evictedBytes / 1048576.0, meshRestores);
+        printf("  Stream: %.1fKB/frame, %d fence stalls, %d overflows\n",
+               frames > 0 ? streamBytes / 1024.0 / frames : 0.0, streamFenceStalls, streamOverflows);
+        printf("  Atmosphere: %s, %d draws, %.1fk tris/frame, fill %.1fk samples/frame, overdraw %.2f\n",
+               atmosphereInside ? "inside" : "outside", atmosphereDrawCalls,
+               frames > 0 ? atmosphereTriangles / 1000.0 / frames : 0.0,
+               frames > 0 ? atmosphereSamples / 1000.0 / frames : 0.0,
+               screenSamples > 0 ? (double)atmosphereSamples / screenSamples : 0.0);
+
+        printf("  Bodies: %d, %.1f detailed and %.1f impostors/frame, %d generating\n", bodies,
+               frames > 0 ? (double)bodiesDetailed / frames : 0.0, frames > 0 ? (double)bodyImpostors / frames : 0.0,
+               bodiesGenerating);
+        printf("  Terrain: %.1fk tris/frame, %.1fk culled; %.1f of %.1f chunks/frame occluded, %.1f off screen, "
+               "%.1fk occluder tris, %.2fms/frame\n",
+               frames > 0 ? terrainTriangles / 1000.0 / frames : 0.0,
+               frames > 0 ? terrainTrianglesCulled / 1000.0 / frames : 0.0,
+               frames > 0 ? (double)chunksOccluded / frames : 0.0, frames > 0 ? (double)chunksTested / frames : 0.0,
+               frames > 0 ? (double)chunksOutside / frames : 0.0,
+               frames > 0 ? occluderTriangles / 1000.0 / frames : 0.0,
+               frames > 0 ? 1000.0 * occlusionTime / frames : 0.0);
+        printf("  Stars: %.1fk/frame from %.1f cells/frame, down to magnitude %.2f\n",
+               frames > 0 ? starsDrawn / 1000.0 / frames : 0.0, frames > 0 ? (double)starCells / frames : 0.0, starLimit);
+        printf("  Asteroids: %.0fk, step %.2fms/tick (budget %.2fms), drawn %.1fk/%.1fk/%.1fk by level, %d dropped\n",
+               asteroids / 1000.0, simTicks > 0 ? 1000.0 * asteroidStepTime / simTicks : 0.0, 1000.0 * asteroidStepBudget,
+               frames > 0 ? asteroidsDrawn[0] / 1000.0 / frames : 0.0, frames > 0 ? asteroidsDrawn[1] / 1000.0 / frames : 0.0,
+               frames > 0 ? asteroidsDrawn[2] / 1000.0 / frames : 0.0, asteroidsDropped);
+        if (gravityTreeBuildTicks > 0) {
+            printf("  Gravity: tree of %.1fk nodes (built in %.2fms over %d ticks), %d rocks/tick refreshed, sweep %.1fs\n",
+                   gravityTreeNodes / 1000.0, 1000.0 * gravityTreeBuildTime, gravityTreeBuildTicks, gravityRefreshSlice,
+                   gravitySweepTime);
+        } else {
+            printf("  Gravity: tree of %.1fk nodes (built in %.2fms), %d rocks/tick refreshed, sweep %.1fs\n",
+                   gravityTreeNodes / 1000.0, 1000.0 * gravityTreeBuildTime, gravityRefreshSlice, gravitySweepTime);
+        }
+        if (shipApoapsis < 0.0) {
+            printf("  Ship: %s near %s, altitude %.0f, speed %.1f, periapsis %.0f, escaping\n",
+                   shipOrbital ? "orbital" : "arcade", shipBody, shipAltitude, shipSpeed, shipPeriapsis);
+        } else {
+            printf("  Ship: %s near %s, altitude %.0f, speed %.1f, periapsis %.0f, apoapsis %.0f\n",
+                   shipOrbital ? "orbital" : "arcade", shipBody, shipAltitude, shipSpeed, shipPeriapsis, shipApoapsis);
+        }
+
+        if (jobWorkers > 0) {
+            printf("  Jobs: %d run, %d steals, utilisation", jobsRun, jobSteals);
+            for (int i = 0; i < jobWorkers; ++i) {
+                printf(" %.0f%%", 100.0 * jobBusyMicroseconds[i] / (1000000.0 * elapsed));
+            }
+            printf("\n");
+        }
+
+        reset(now);
+    }
+};
+
+FrameStats frameStats;
@@ -0,0 +1,207 @@
+//
+//  StreamBuffer.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Ring buffer for vertex data that changes every frame.
+//
+// One GL buffer is split into three segments. Each frame writes into the
+// next segment and drops a fence behind it, so by the time a segment comes
+// round again the GPU has (almost always) finished with it and we can write
+// without the driver having to stall or shadow-copy the storage.
+//
+// With GL 4.4 / ARB_buffer_storage the whole buffer is mapped once,
+// persistently and coherently. Otherwise (e.g. macOS, which tops out at 4.1)
+// each allocation is mapped unsynchronized - safe because the fences already
+// guarantee the range isn't in flight.
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (*BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+struct StreamAllocation {
+    void *data;
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+struct StreamBuffer {
+    static const int numSegments = 3;
+
+    GLenum target = GL_ARRAY_BUFFER;
+    GLuint buffer = 0;
+    GLsizeiptr segmentSize = 0;
+
+    int segment = 0;
+    GLsizeiptr used = 0;
+    GLsync fences[numSegments] = {0, 0, 0};
+
+    bool persistent = false;
+    unsigned char *persistentBase = NULL;
+
+    // Stats, reset by the caller
+    GLsizeiptr bytesWritten = 0;
+    int fenceStalls = 0;
+    int overflows = 0;
+
+    void init(GLenum _target, GLsizeiptr _segmentSize) {
+        target = _target;
+        segmentSize = _segmentSize;
+
+        GLsizeiptr totalSize = segmentSize * numSegments;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        CHECK_GL_ERRORS();
+
+        BufferStorageProc bufferStorage = NULL;
+
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+        if (major > 4 || (major == 4 && minor >= 4)) {
+            bufferStorage = (BufferStorageProc)SDL_GL_GetProcAddress("glBufferStorage");
+        }
+
+        if (bufferStorage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(target, totalSize, NULL, flags);
+            persistentBase = (unsigned char *)glMapBufferRange(target, 0, totalSize, flags);
+            persistent = (persistentBase != NULL);
+        }
+
+        if (!persistent) {
+            glBufferData(target, totalSize, NULL, GL_STREAM_DRAW);
+        }
+        CHECK_GL_ERRORS();
+
+        gpuMemory.allocate(GpuMemoryStream, totalSize);
+
+        printf("Stream buffer: %ld bytes x %d, %s\n", (long)segmentSize, numSegments,
+               persistent ? "persistent" : "unsynchronized maps");
+    }
+
+    // Space for `size` bytes in this frame's segment. Returns false when the
+    // segment is full; the caller should skip whatever it was drawing.
+    bool allocate(GLsizeiptr size, GLsizeiptr alignment, StreamAllocation &allocation) {
+        GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+
+        if (start + size > segmentSize) {
+            overflows += 1;
+            return false;
+        }
+
+        allocation.offset = segment * segmentSize + start;
+        allocation.size = size;
+
+        if (persistent) {
+            allocation.data = persistentBase + allocation.offset;
+        } else {
+            glBindBuffer(target, buffer);
+            allocation.data = glMapBufferRange(target, allocation.offset, size,
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            CHECK_GL_ERRORS();
+
+            if (allocation.data == NULL) {
+                return false;
+            }
+        }
+
+        used = start + size;
+        bytesWritten += size;
+
+        return true;
+    }
+
+    // Give back the unused tail of the most recent allocation
+    void trim(StreamAllocation &allocation, GLsizeiptr size) {
+        assert(size <= allocation.size);
+        assert(allocation.offset + allocation.size == segment * segmentSize + used);
+
+        used -= allocation.size - size;
+        bytesWritten -= allocation.size - size;
+        allocation.size = size;
+    }
+
+    // Done writing into an allocation. Without persistent mapping only one
+    // allocation can be open (mapped) at a time, so it has to be the latest.
+    void commit(const StreamAllocation &allocation) {
+        assert(allocation.offset + allocation.size == segment * segmentSize + used);
+
+        if (!persistent) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            CHECK_GL_ERRORS();
+        }
+    }
+
+    // Call after the frame's draws have been submitted
+    void endFrame() {
+        if (fences[segment]) {
+            glDeleteSync(fences[segment]);
+        }
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        segment = (segment + 1) % numSegments;
+        used = 0;
+
+        // Make sure the GPU is done with the segment we're about to reuse.
+        // Writing over it early would corrupt draws still in flight, so keep
+        // waiting however long it takes, and say so if it's taking a while.
+        GLsync fence = fences[segment];
+        if (fence) {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+
+            if (result == GL_TIMEOUT_EXPIRED) {
+                fenceStalls += 1;
+
+                int seconds = 0;
+                while ((result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL)) == GL_TIMEOUT_EXPIRED) {
+                    seconds += 1;
+                    printf("Stream buffer: GPU still using segment %d after %ds\n", segment, seconds);
+                }
+            }
+
+            if (result == GL_WAIT_FAILED) {
+                printf("Error: stream buffer fence wait failed, segment %d may still be in use\n", segment);
+            }
+
+            glDeleteSync(fence);
+            fences[segment] = 0;
+        }
+        CHECK_GL_ERRORS();
+    }
+
+    void destroy() {
+        for (int i = 0; i < numSegments; ++i) {
+            if (fences[i]) {
+                glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+        }
+
+        if (buffer != 0) {
+            if (persistent) {
+                glBindBuffer(target, buffer);
+                glUnmapBuffer(target);
+            }
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+
+            gpuMemory.release(GpuMemoryStream, segmentSize * numSegments);
+        }
+
+        persistent = false;
+        persistentBase = NULL;
+    }
+};
@@ -0,0 +1,1635 @@
+//
+//  Terrain.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+#include <unordered_map>
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <float.h>
+
+// Set up in setupGL. Two octaves at frequencies 4 and 7 gives the original terrain;
+// raise the octave count for more detail. Other bodies copy it with their own seed.
+FractalNoise terrainNoise;
+
+// Seed 0 is the reference permutation, i.e. the original planet
+const uint32_t planetSeed = 0;
+NoiseContext planetNoise(planetSeed);
+
+// How far the remaining octaves may be ignored by (0 = evaluate them all).
+// About 0.15 units of height on the home planet, well inside what the
+// noise precisions are allowed (see TerrainFace::begin).
+const double terrainNoiseTolerance = 1.0e-3;
+
+// Noise value at the shore. terrainVertex() flattens everything under it, so
+// once the remaining octaves can't lift a point back over it they're skipped,
+// and only the water's shade comes from fewer octaves.
+const double terrainSeaLevel = -0.1;
+
+// For the highest terrain frequency (recorded, or measured with --report), used to pick a noise precision per mesh resolution
+NoiseAccuracy terrainNoiseAccuracy;
+
+// Terrain heights are fractions of the planet radius times this (the home
+// planet's; other bodies can pick their own)
+const double terrainHeightMultiplier = 0.025;
+
+inline float normalizedHeightAboveSeaLevel(FractalNoise &noise, const v3 &basePt, int octaveLimit = FractalNoise::maxOctaves,
+                                           NoisePrecision precision = NoisePrecisionDouble) {
+    v3 pt = v3normalize(basePt);
+
+    float height = noise.evaluate(pt, terrainNoiseTolerance, octaveLimit, precision, NULL, terrainSeaLevel);
+
+    return height;
+}
+
+// Position and colour for the vertex in direction `dir` (unit length) with
+// noise height `height`. Anything below sea level sits on the water surface.
+inline void terrainVertex(const v3 &dir, float height, float radius, float heightMultiplier, v3 &pt, v4 &col) {
+
+    height -= terrainSeaLevel;
+
+    float distFromCentre = radius * (1.0 + height * heightMultiplier);
+
+    if (height < 0.0) {
+        distFromCentre = radius;
+    }
+
+    pt = distFromCentre * dir;
+
+    if (height < 0.0) {
+        col.r = 0.2;
+        col.g = 0.2 - height * 0.5;
+        col.b = 1.0;
+    } else if (height < 0.8) {
+        col.r = 0.2 + 0.4 * height;
+        col.g = 0.5;
+        col.b = 0.1 + 0.4 * height;
+    } else {
+        col.r = 0.9;
+        col.g = 0.9;
+        col.b = 0.9;
+    }
+    col.a = 1.0;
+}
+
+// Colour only depends on the noise height, so vertices carry an index into a
+// table of it rather than the colour itself. Heights up to the snow line are
+// spread over all but the last entry, which is the snow. Below
+// terrainPaletteLow the water has gone as light as it goes.
+const int terrainPaletteSize = 256;
+const float terrainPaletteLow = -1.7;
+const float terrainPaletteSnow = 0.7;   // Where terrainVertex() switches
+
+inline int terrainPaletteIndex(float height) {
+    if (height >= terrainPaletteSnow) {
+        return terrainPaletteSize - 1;
+    }
+
+    float t = (height - terrainPaletteLow) / (terrainPaletteSnow - terrainPaletteLow);
+    int index = (int)lrintf(t * (terrainPaletteSize - 2));
+
+    return index < 0 ? 0 : (index > terrainPaletteSize - 2 ? terrainPaletteSize - 2 : index);
+}
+
+inline float terrainPaletteHeight(int index) {
+    if (index == terrainPaletteSize - 1) {
+        return terrainPaletteSnow + 1.0;
+    }
+    return terrainPaletteLow + (terrainPaletteSnow - terrainPaletteLow) * index / (terrainPaletteSize - 2);
+}
+
+// 1D texture of terrainVertex() colours, made on first use
+GLuint terrainPaletteTexture = 0;
+
+void bindTerrainPalette() {
+    if (terrainPaletteTexture == 0) {
+        unsigned char texels[4 * terrainPaletteSize];
+
+        for (int i = 0; i < terrainPaletteSize; ++i) {
+            v3 pt;
+            v4 col;
+            terrainVertex(v3(0.0, 0.0, 1.0), terrainPaletteHeight(i), 1.0, 0.0, pt, col);
+
+            const float channels[4] = { col.r, col.g, col.b, col.a };
+            for (int c = 0; c < 4; ++c) {
+                texels[4 * i + c] = (unsigned char)lrintf(255.0f * fmin(fmax(channels[c], 0.0f), 1.0f));
+            }
+        }
+
+        glGenTextures(1, &terrainPaletteTexture);
+        glBindTexture(GL_TEXTURE_1D, terrainPaletteTexture);
+        glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, terrainPaletteSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        CHECK_GL_ERRORS();
+
+        gpuMemory.allocate(GpuMemoryTexture, sizeof(texels));
+    }
+
+    glBindTexture(GL_TEXTURE_1D, terrainPaletteTexture);
+}
+
+void destroyTerrainPalette() {
+    if (terrainPaletteTexture != 0) {
+        glDeleteTextures(1, &terrainPaletteTexture);
+        terrainPaletteTexture = 0;
+
+        gpuMemory.release(GpuMemoryTexture, 4 * terrainPaletteSize);
+    }
+}
+
+// A terrain vertex as it goes to the GPU: 8 bytes against the 32 of a float
+// position, packed normal and float colour. Only the height is stored, the
+// direction comes back from the vertex's place in the grid (see
+// TerrainVertex.glsl, which decodes all of it).
+struct TerrainVertex {
+    uint16_t height;        // Surface height, 0 to the terrain's heightRange
+    uint8_t palette;        // See terrainPaletteIndex()
+    uint8_t unused;
+    int16_t normal[2];      // Octahedral, times 32767
+};
+
+const MeshAttribute terrainVertexAttributes[] = {
+    {0, 1, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(TerrainVertex, height)},
+    {1, 2, GL_SHORT, GL_FALSE, offsetof(TerrainVertex, normal)},
+    {2, 1, GL_UNSIGNED_BYTE, GL_FALSE, offsetof(TerrainVertex, palette)},
+};
+const int numTerrainVertexAttributes = sizeof(terrainVertexAttributes) / sizeof(terrainVertexAttributes[0]);
+
+const ShaderAttribute terrainShaderAttributes[] = {
+    {0, "in_Height"},
+    {1, "in_Normal"},
+    {2, "in_Palette"},
+};
+const int numTerrainShaderAttributes = sizeof(terrainShaderAttributes) / sizeof(terrainShaderAttributes[0]);
+
+// Where the terrain shader wants the face and body it's decoding, and what
+// it's lit by. Looked up again whenever the program is rebuilt.
+struct TerrainUniforms {
+    int generation;
+    GLint faceStart;
+    GLint faceAcross;
+    GLint faceUp;
+    GLint shape;
+    GLint modelOffset;
+    GLint sunDirection;
+    GLint palette;
+
+    TerrainUniforms() {
+        generation = -1;
+    }
+
+    void refresh(ShaderManager *shaders, ShaderHandle shader) {
+        if (!shaders->changedSince(shader, generation)) {
+            return;
+        }
+
+        faceStart = shaders->uniformLocation(shader, "faceStart");
+        faceAcross = shaders->uniformLocation(shader, "faceAcross");
+        faceUp = shaders->uniformLocation(shader, "faceUp");
+        shape = shaders->uniformLocation(shader, "terrainShape");
+        modelOffset = shaders->uniformLocation(shader, "modelOffset");
+        sunDirection = shaders->uniformLocation(shader, "sunDirection");
+        palette = shaders->uniformLocation(shader, "terrainPalette");
+    }
+};
+
+// Faces are split into chunks this many to a side for occlusion culling
+// (see Terrain::testChunks). Each has its own run in every index list.
+const int terrainChunksPerSide = 6;
+const int numTerrainChunks = terrainChunksPerSide * terrainChunksPerSide;
+const uint64_t allTerrainChunks = (numTerrainChunks == 64) ? ~0ULL : (1ULL << numTerrainChunks) - 1;
+
+// Index lists for every face of one resolution, in a single buffer they all
+// share. Level 0 is the full grid, with one variant per combination of sides
+// stitched to a level 1 neighbour (see GridSide); level 1 is every other
+// vertex. Only level 0 ever needs stitching, a coarser face's edge vertices
+// are all on its finer neighbour too.
+struct TerrainIndices {
+    static const int numLevels = 2;
+    static const int numLists = numGridStitchMasks + 1;
+
+    int squaresPerSide;
+    int users;
+    GLuint buffer;
+    long bytes;
+
+    int first[numLists];
+    int count[numLists];
+
+    // Where each chunk starts in each list (from the start of the buffer),
+    // plus the end of the last
+    int chunkFirst[numLists][numTerrainChunks + 1];
+
+    static int list(int level, int stitchedSides) {
+        return level == 0 ? stitchedSides : numGridStitchMasks;
+    }
+};
+
+// Made on the GL thread when a face of that resolution first uploads, gone
+// when the last face using it is destroyed
+std::vector<TerrainIndices *> terrainIndices;
+
+TerrainIndices *acquireTerrainIndices(int squaresPerSide) {
+    for (size_t i = 0; i < terrainIndices.size(); ++i) {
+        if (terrainIndices[i]->squaresPerSide == squaresPerSide) {
+            terrainIndices[i]->users += 1;
+            return terrainIndices[i];
+        }
+    }
+
+    TerrainIndices *set = new TerrainIndices();
+    set->squaresPerSide = squaresPerSide;
+    set->users = 1;
+
+    std::vector<ushort> all;
+    for (int l = 0; l < TerrainIndices::numLists; ++l) {
+        int level = l < numGridStitchMasks ? 0 : 1;
+        int numIndices;
+        ushort *indices = buildGridTriangleIndices(squaresPerSide, &numIndices, vertexCacheSize,
+                                                   1 << level, level == 0 ? l : 0,
+                                                   terrainChunksPerSide, set->chunkFirst[l]);
+
+        set->first[l] = (int)all.size();
+        set->count[l] = numIndices;
+        for (int c = 0; c <= numTerrainChunks; ++c) {
+            set->chunkFirst[l][c] += set->first[l];
+        }
+        all.insert(all.end(), indices, indices + numIndices);
+
+        free(indices);
+    }
+
+    set->bytes = all.size() * sizeof(ushort);
+
+    glGenBuffers(1, &set->buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, set->buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, set->bytes, &all[0], GL_STATIC_DRAW);
+    CHECK_GL_ERRORS();
+    gpuMemory.allocate(GpuMemoryIndex, set->bytes);
+
+    printf("Terrain indices: %d squares/side, %d lists, %.1fkB shared\n", squaresPerSide,
+           TerrainIndices::numLists, set->bytes / 1024.0);
+
+    terrainIndices.push_back(set);
+    return set;
+}
+
+void releaseTerrainIndices(TerrainIndices *set) {
+    set->users -= 1;
+    if (set->users > 0) {
+        return;
+    }
+
+    glDeleteBuffers(1, &set->buffer);
+    gpuMemory.release(GpuMemoryIndex, set->bytes);
+
+    for (size_t i = 0; i < terrainIndices.size(); ++i) {
+        if (terrainIndices[i] == set) {
+            terrainIndices.erase(terrainIndices.begin() + i);
+            break;
+        }
+    }
+    delete set;
+}
+
+typedef enum {
+    TerrainEditCrater,
+    TerrainEditRaise,
+    TerrainEditFlatten,
+} TerrainEditType;
+
+struct TerrainEdit {
+    TerrainEditType type;
+    v3 centre;      // Unit direction from the planet centre
+    float radius;   // Angular radius, radians
+    float amount;   // Depth / height change, or target height for flatten (noise units)
+};
+
+struct TerrainFace;
+void restoreTerrainFace(Mesh *mesh, void *owner);
+
+// One cube face of the planet. Keeps the CPU side of its vertex data so
+// edits can be applied in place: the generated heights are left alone and
+// edits accumulate in a sparse per-vertex overlay.
+struct TerrainFace {
+    int squaresPerSide;
+    int numVerts;
+    float radius;
+
+    FractalNoise *noise;
+    float heightMultiplier;
+
+    v3 startPt, acrossDir, upDir;
+    v3 faceNormal;
+
+    v3 *directions;
+    float *baseHeights;
+
+    // Final surface height of each vertex above `radius` in world units (edits
+    // and the sea included), for height queries without touching the noise
+    float *surfaceHeights;
+    float maxSurfaceHeight;
+
+    // Surface height at the top of the GPU copy's range, see TerrainVertex
+    float heightRange;
+
+    v3 *verts;
+    v3 *norms;
+
+    std::unordered_map<int, float> deltas;
+
+    // Block of the grid whose normals the last applyEdit() recomputed,
+    // empty (max < min) if it changed nothing
+    int editMinI, editMaxI, editMinJ, editMaxJ;
+
+    // Planet-local box round each chunk's vertices, lined up with the
+    // chunk's middle (see findChunkBounds()): centre and half-size axes
+    v3 chunkCentre[numTerrainChunks];
+    v3 chunkAxes[numTerrainChunks][3];
+
+    // Coarse stand-in for the surface that never pokes out of it, for
+    // occlusion culling: an occluderCellsPerSide grid over the face with
+    // each vertex at the lowest surface height of the cells around it
+    static const int occluderCellsPerSide = 16;
+    float occluderHeights[(occluderCellsPerSide + 1) * (occluderCellsPerSide + 1)];
+    float occluderCellMin[occluderCellsPerSide * occluderCellsPerSide];
+
+    Mesh mesh;
+    TerrainIndices *indices;
+
+    TerrainFace() {
+        squaresPerSide = 0;
+        numVerts = 0;
+        octaveLimit = FractalNoise::maxOctaves;
+        precision = NoisePrecisionDouble;
+        radius = 0.0;
+        noise = &terrainNoise;
+        heightMultiplier = terrainHeightMultiplier;
+        directions = NULL;
+        baseHeights = NULL;
+        surfaceHeights = NULL;
+        maxSurfaceHeight = 0.0;
+        heightRange = 1.0;
+        verts = NULL;
+        norms = NULL;
+        indices = NULL;
+        editMinI = editMinJ = 0;
+        editMaxI = editMaxJ = -1;
+    }
+
+    int rowLength() {
+        return squaresPerSide + 1;
+    }
+
+    float height(int index) {
+        float result = baseHeights[index];
+
+        if (!deltas.empty()) {
+            std::unordered_map<int, float>::iterator found = deltas.find(index);
+            if (found != deltas.end()) {
+                result += found->second;
+            }
+        }
+
+        return result;
+    }
+
+    // Set by begin() for generateRows()
+    int octaveLimit;
+    NoisePrecision precision;
+
+    // Building is split in three so Terrain::build can spread the rows of
+    // every face across the job system: begin() and finish() on the main
+    // thread, generateRows() and computeNormals() on any thread.
+    void begin(int _squaresPerSide, v3 _startPt, v3 _acrossDir, v3 _upDir, float _radius,
+               FractalNoise *_noise, float _heightMultiplier) {
+        squaresPerSide = _squaresPerSide;
+        startPt = _startPt;
+        acrossDir = _acrossDir;
+        upDir = _upDir;
+        radius = _radius;
+        noise = _noise;
+        heightMultiplier = _heightMultiplier;
+        faceNormal = v3normalize(startPt + 0.5 * acrossDir + 0.5 * upDir);
+
+        numVerts = rowLength() * rowLength();
+
+        // Faces span 2 units, so this is roughly the vertex spacing on the unit sphere
+        octaveLimit = noise->octavesForSpacing(2.0 / squaresPerSide);
+
+        // Allow noise error up to 1% of the vertex spacing, in world units
+        double heightScale = heightMultiplier * radius;
+        double allowedError = 0.01 * (2.0 * radius / squaresPerSide) / heightScale;
+        precision = noise->precisionForError(terrainNoiseAccuracy, allowedError);
+
+        directions = (v3 *)malloc(sizeof(v3) * numVerts);
+        baseHeights = (float *)malloc(sizeof(float) * numVerts);
+        surfaceHeights = (float *)malloc(sizeof(float) * numVerts);
+        verts = (v3 *)malloc(sizeof(v3) * numVerts);
+        norms = (v3 *)malloc(sizeof(v3) * numVerts);
+    }
+
+    // Vertices for grid rows [firstRow, endRow)
+    void generateRows(int firstRow, int endRow) {
+        float scaleFactor = 1.0 / squaresPerSide;
+
+        int vertIndex = firstRow * rowLength();
+        for (int j = firstRow; j < endRow; ++j) {
+
+            for (int i = 0; i <= squaresPerSide; ++i) {
+
+                v3 dir = cubeFaceDirection(startPt, acrossDir, upDir, i * scaleFactor, j * scaleFactor);
+
+                directions[vertIndex] = dir;
+                baseHeights[vertIndex] = normalizedHeightAboveSeaLevel(*noise, dir, octaveLimit, precision);
+
+                // Colour goes up as a palette index instead, see packVertices()
+                v4 col;
+                terrainVertex(dir, baseHeights[vertIndex], radius, heightMultiplier, verts[vertIndex], col);
+                updateSurfaceHeight(vertIndex);
+
+                vertIndex += 1;
+            }
+        }
+    }
+
+    float findMaxSurfaceHeight() {
+        maxSurfaceHeight = 0.0;
+        for (int i = 0; i < numVerts; ++i) {
+            if (surfaceHeights[i] > maxSurfaceHeight) {
+                maxSurfaceHeight = surfaceHeights[i];
+            }
+        }
+        return maxSurfaceHeight;
+    }
+
+    void finish(float _heightRange) {
+        findMaxSurfaceHeight();
+        heightRange = _heightRange;
+
+        findChunkBounds(0, squaresPerSide, 0, squaresPerSide);
+        findOccluders(0, squaresPerSide, 0, squaresPerSide);
+
+        upload();
+
+        // Everything needed to rebuild the GPU copy stays on the CPU, so the face can be evicted
+        meshCache.add(&mesh, restoreTerrainFace, this);
+    }
+
+    void build(int _squaresPerSide, v3 _startPt, v3 _acrossDir, v3 _upDir, float _radius,
+               FractalNoise *_noise = &terrainNoise, float _heightMultiplier = terrainHeightMultiplier) {
+        begin(_squaresPerSide, _startPt, _acrossDir, _upDir, _radius, _noise, _heightMultiplier);
+        generateRows(0, rowLength());
+        computeNormals(0, squaresPerSide, 0, squaresPerSide);
+        finish(2.0 * findMaxSurfaceHeight() + 1.0);
+    }
+
+    void upload() {
+        // Triangle lists ordered for the vertex cache, shared with every
+        // other face of this resolution
+        if (indices == NULL) {
+            indices = acquireTerrainIndices(squaresPerSide);
+        }
+
+        TerrainVertex *packed = (TerrainVertex *)malloc(sizeof(TerrainVertex) * numVerts);
+        packVertices(0, numVerts, packed);
+
+        mesh.primitive = GL_TRIANGLES;
+        mesh.sharedIndexBuffer = indices->buffer;
+        mesh.setupInterleaved(numVerts, packed, sizeof(TerrainVertex), terrainVertexAttributes,
+                              numTerrainVertexAttributes, indices->count[0], NULL);
+
+        free(packed);
+    }
+
+    // GPU copy of vertices [first, first + count)
+    void packVertices(int first, int count, TerrainVertex *packed) {
+        float heightScale = 65535.0 / heightRange;
+
+        for (int k = 0; k < count; ++k) {
+            int index = first + k;
+            TerrainVertex &vertex = packed[k];
+
+            // Edits can in principle pile up past the range; those just clip
+            float h = surfaceHeights[index] * heightScale;
+            vertex.height = (uint16_t)lrintf(h < 0.0f ? 0.0f : (h > 65535.0f ? 65535.0f : h));
+
+            vertex.palette = (uint8_t)terrainPaletteIndex(height(index));
+            vertex.unused = 0;
+
+            float u, v;
+            octahedralEncode(norms[index], u, v);
+            vertex.normal[0] = (int16_t)lrintf(u * 32767.0f);
+            vertex.normal[1] = (int16_t)lrintf(v * 32767.0f);
+        }
+    }
+
+    // Re-uploads a run of vertices if the face is on the GPU
+    void updateVertices(int first, int count) {
+        if (!mesh.resident()) {
+            return;
+        }
+
+        TerrainVertex *packed = (TerrainVertex *)malloc(sizeof(TerrainVertex) * count);
+        packVertices(first, count, packed);
+        mesh.updateInterleaved(first, count, packed);
+        free(packed);
+    }
+
+    // Where the GPU will put vertex `index` from its packed form, the same
+    // sums as TerrainVertex.glsl. For measuring what the packing loses.
+    void decodeVertex(int index, const TerrainVertex &vertex, v3 &pt, v3 &normal) {
+        float u = (float)(index % rowLength()) / squaresPerSide;
+        float v = (float)(index / rowLength()) / squaresPerSide;
+
+        if (u > 0.0 && u < 1.0) u = warpFaceCoordinate(u);
+        if (v > 0.0 && v < 1.0) v = warpFaceCoordinate(v);
+
+        v3 dir = v3normalize(startPt + u * acrossDir + v * upDir);
+        pt = (radius + vertex.height / 65535.0f * heightRange) * dir;
+
+        normal = octahedralDecode(vertex.normal[0] / 32767.0f, vertex.normal[1] / 32767.0f);
+    }
+
+    // Face corner and edges for the shader to rebuild directions from
+    void setUniforms(const TerrainUniforms &uniforms) {
+        glUniform3f(uniforms.faceStart, startPt.x, startPt.y, startPt.z);
+        glUniform3f(uniforms.faceAcross, acrossDir.x, acrossDir.y, acrossDir.z);
+        glUniform3f(uniforms.faceUp, upDir.x, upDir.y, upDir.z);
+    }
+
+    // At level 0 `stitchedSides` are the sides with a level 1 neighbour.
+    // Only the chunks set in `chunks` are drawn, runs of them together.
+    // Adds the triangles drawn and left out to `drawn` and `culled`.
+    void draw(int level, int stitchedSides, uint64_t chunks, long &drawn, long &culled) {
+        int list = TerrainIndices::list(level, stitchedSides);
+        const int *chunkFirst = indices->chunkFirst[list];
+
+        if (chunks == allTerrainChunks) {
+            mesh.drawRange(indices->first[list], indices->count[list]);
+            drawn += indices->count[list] / 3;
+            return;
+        }
+
+        int c = 0;
+
+        while (c < numTerrainChunks) {
+            int end = c;
+            while (end < numTerrainChunks && (chunks & (1ULL << end))) {
+                end += 1;
+            }
+
+            if (end > c) {
+                mesh.drawRange(chunkFirst[c], chunkFirst[end] - chunkFirst[c]);
+                drawn += (chunkFirst[end] - chunkFirst[c]) / 3;
+                c = end;
+            } else {
+                culled += (chunkFirst[c + 1] - chunkFirst[c]) / 3;
+                c += 1;
+            }
+        }
+    }
+
+    // Grid vertex range of chunk `chunk`
+    void chunkRange(int chunk, int &minI, int &maxI, int &minJ, int &maxJ) {
+        int chunkI = chunk % terrainChunksPerSide;
+        int chunkJ = chunk / terrainChunksPerSide;
+
+        minI = gridChunkStart(squaresPerSide, terrainChunksPerSide, chunkI);
+        maxI = gridChunkStart(squaresPerSide, terrainChunksPerSide, chunkI + 1);
+        minJ = gridChunkStart(squaresPerSide, terrainChunksPerSide, chunkJ);
+        maxJ = gridChunkStart(squaresPerSide, terrainChunksPerSide, chunkJ + 1);
+    }
+
+    // A box square to the planet's axes would be mostly air on a curved
+    // chunk, so each is lined up with its middle: up, across and along the face.
+    // Only chunks sharing a vertex with the given block are refitted.
+    void findChunkBounds(int blockMinI, int blockMaxI, int blockMinJ, int blockMaxJ) {
+        // Covers the GPU's decoding error (see reportVertexPacking) many times over
+        const float margin = 1.0;
+        int row = rowLength();
+
+        for (int c = 0; c < numTerrainChunks; ++c) {
+            int minI, maxI, minJ, maxJ;
+            chunkRange(c, minI, maxI, minJ, maxJ);
+
+            if (maxI < blockMinI || minI > blockMaxI || maxJ < blockMinJ || minJ > blockMaxJ) {
+                continue;
+            }
+
+            v3 axes[3];
+            axes[2] = directions[((minJ + maxJ) / 2) * row + (minI + maxI) / 2];
+            axes[0] = v3normalize(acrossDir - v3dot(acrossDir, axes[2]) * axes[2]);
+            axes[1] = v3cross(axes[2], axes[0]);
+
+            float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+            float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+            for (int j = minJ; j <= maxJ; ++j) {
+                for (int i = minI; i <= maxI; ++i) {
+                    const v3 &pt = verts[j * row + i];
+                    for (int a = 0; a < 3; ++a) {
+                        float d = v3dot(pt, axes[a]);
+                        low[a] = fmin(low[a], d);
+                        high[a] = fmax(high[a], d);
+                    }
+                }
+            }
+
+            chunkCentre[c] = v3(0.0f, 0.0f, 0.0f);
+            for (int a = 0; a < 3; ++a) {
+                chunkCentre[c] = chunkCentre[c] + (0.5f * (low[a] + high[a])) * axes[a];
+                chunkAxes[c][a] = (0.5f * (high[a] - low[a]) + margin) * axes[a];
+            }
+        }
+    }
+
+    // Grid square where occluder cell column (or row) `k` starts
+    int occluderStart(int k) {
+        return k * squaresPerSide / occluderCellsPerSide;
+    }
+
+    // Only cells sharing a vertex with the given block are rescanned, and
+    // only the corners of those cells move
+    void findOccluders(int blockMinI, int blockMaxI, int blockMinJ, int blockMaxJ) {
+        const int cells = occluderCellsPerSide;
+        int row = rowLength();
+
+        int minK = cells, maxK = -1, minL = cells, maxL = -1;
+        for (int k = 0; k < cells; ++k) {
+            if (occluderStart(k) <= blockMaxI && occluderStart(k + 1) >= blockMinI) {
+                if (k < minK) minK = k;
+                maxK = k;
+            }
+            if (occluderStart(k) <= blockMaxJ && occluderStart(k + 1) >= blockMinJ) {
+                if (k < minL) minL = k;
+                maxL = k;
+            }
+        }
+
+        for (int l = minL; l <= maxL; ++l) {
+            for (int k = minK; k <= maxK; ++k) {
+                float lowest = surfaceHeights[occluderStart(l) * row + occluderStart(k)];
+
+                for (int j = occluderStart(l); j <= occluderStart(l + 1); ++j) {
+                    for (int i = occluderStart(k); i <= occluderStart(k + 1); ++i) {
+                        lowest = fmin(lowest, surfaceHeights[j * row + i]);
+                    }
+                }
+                occluderCellMin[l * cells + k] = lowest;
+            }
+        }
+
+        // A vertex no higher than any cell it's on keeps every triangle
+        // under the real surface, and a coarse chord sags further into the
+        // sphere than the fine ones it replaces
+        for (int l = minL; l <= maxL + 1; ++l) {
+            for (int k = minK; k <= maxK + 1; ++k) {
+                float lowest = FLT_MAX;
+
+                for (int cl = l - 1; cl <= l; ++cl) {
+                    for (int ck = k - 1; ck <= k; ++ck) {
+                        if (cl >= 0 && cl < cells && ck >= 0 && ck < cells) {
+                            lowest = fmin(lowest, occluderCellMin[cl * cells + ck]);
+                        }
+                    }
+                }
+                occluderHeights[l * (cells + 1) + k] = lowest;
+            }
+        }
+    }
+
+    // `offset` takes planet-local points to camera-relative ones
+    void drawOccluders(OcclusionBuffer &buffer, const v3 &offset) {
+        const int cells = occluderCellsPerSide;
+        v3 points[(cells + 1) * (cells + 1)];
+        int row = rowLength();
+
+        for (int l = 0; l <= cells; ++l) {
+            for (int k = 0; k <= cells; ++k) {
+                int index = occluderStart(l) * row + occluderStart(k);
+                points[l * (cells + 1) + k] = offset + (radius + occluderHeights[l * (cells + 1) + k]) * directions[index];
+            }
+        }
+
+        for (int l = 0; l < cells; ++l) {
+            for (int k = 0; k < cells; ++k) {
+                const v3 *p = points + l * (cells + 1) + k;
+                buffer.drawTriangle(p[0], p[cells + 1], p[1]);
+                buffer.drawTriangle(p[1], p[cells + 1], p[cells + 2]);
+            }
+        }
+    }
+
+    // Chunks not hidden by whatever's in `buffer`, as a mask for draw()
+    uint64_t testChunks(OcclusionBuffer &buffer, const v3 &offset) {
+        uint64_t visible = 0;
+
+        for (int c = 0; c < numTerrainChunks; ++c) {
+            OcclusionBuffer::Result result = buffer.testBox(chunkCentre[c] + offset, chunkAxes[c]);
+
+            buffer.stats.chunksTested += 1;
+            if (result == OcclusionBuffer::OcclusionVisible) {
+                visible |= 1ULL << c;
+            } else if (result == OcclusionBuffer::OcclusionHidden) {
+                buffer.stats.chunksOccluded += 1;
+            } else {
+                buffer.stats.chunksOutside += 1;
+            }
+        }
+
+        return visible;
+    }
+
+    void updateSurfaceHeight(int index) {
+        surfaceHeights[index] = v3length(verts[index]) - radius;
+    }
+
+    // Where `dir` (any length) hits this face, as 0..1 across and up the grid.
+    // Returns false if it lands on a different face.
+    bool faceCoordinates(const v3 &dir, float &u, float &v) {
+        float facing = v3dot(dir, faceNormal);
+        if (facing <= 0.0) {
+            return false;
+        }
+
+        v3 onPlane = (1.0f / facing) * dir - startPt;
+
+        u = v3dot(onPlane, acrossDir) / v3dot(acrossDir, acrossDir);
+        v = v3dot(onPlane, upDir) / v3dot(upDir, upDir);
+
+        if (u < 0.0 || u > 1.0 || v < 0.0 || v > 1.0) {
+            return false;
+        }
+
+        u = unwarpFaceCoordinate(u);
+        v = unwarpFaceCoordinate(v);
+
+        return true;
+    }
+
+    // Bilinear lookup in the surface height grid
+    float sampleHeight(float u, float v) {
+        float x = u * squaresPerSide;
+        float y = v * squaresPerSide;
+
+        int i = (int)x;
+        int j = (int)y;
+
+        if (i > squaresPerSide - 1) i = squaresPerSide - 1;
+        if (j > squaresPerSide - 1) j = squaresPerSide - 1;
+
+        float fx = x - i;
+        float fy = y - j;
+
+        int row = rowLength();
+        const float *h = surfaceHeights + j * row + i;
+
+        float bottom = h[0] + (h[1] - h[0]) * fx;
+        float top = h[row] + (h[row + 1] - h[row]) * fx;
+
+        return bottom + (top - bottom) * fy;
+    }
+
+    // Grid vertex at `cubePt` (a point on the cube, before projecting onto
+    // the sphere), or -1 if it isn't one of this face's
+    int vertexAtCubePoint(const v3 &cubePt) {
+        const float tolerance = 1.0e-4;
+
+        v3 offset = cubePt - startPt;
+        v3 normal = v3normalize(v3cross(acrossDir, upDir));
+        if (fabs(v3dot(offset, normal)) > tolerance) {
+            return -1;
+        }
+
+        float u = v3dot(offset, acrossDir) / v3dot(acrossDir, acrossDir);
+        float v = v3dot(offset, upDir) / v3dot(upDir, upDir);
+        if (u < -tolerance || u > 1.0 + tolerance || v < -tolerance || v > 1.0 + tolerance) {
+            return -1;
+        }
+
+        int i = (int)lrintf(unwarpFaceCoordinate(fmin(fmax(u, 0.0f), 1.0f)) * squaresPerSide);
+        int j = (int)lrintf(unwarpFaceCoordinate(fmin(fmax(v, 0.0f), 1.0f)) * squaresPerSide);
+
+        return j * rowLength() + i;
+    }
+
+    // Central differences across the grid (one-sided on the face edges, see
+    // Terrain::stitchSeams)
+    void computeNormals(int minI, int maxI, int minJ, int maxJ) {
+        int row = rowLength();
+
+        for (int j = minJ; j <= maxJ; ++j) {
+            int jPrev = j > 0 ? j - 1 : j;
+            int jNext = j < squaresPerSide ? j + 1 : j;
+
+            for (int i = minI; i <= maxI; ++i) {
+                int iPrev = i > 0 ? i - 1 : i;
+                int iNext = i < squaresPerSide ? i + 1 : i;
+
+                v3 du = verts[j * row + iNext] - verts[j * row + iPrev];
+                v3 dv = verts[jNext * row + i] - verts[jPrev * row + i];
+
+                v3 n = v3normalize(v3cross(du, dv));
+
+                // Face winding varies, so make sure it points away from the centre
+                if (v3dot(n, directions[j * row + i]) < 0.0) {
+                    n = -1.0f * n;
+                }
+
+                norms[j * row + i] = n;
+            }
+        }
+    }
+
+    // Work out the (conservative) block of grid vertices an edit could touch.
+    // Returns false if the edit can't reach this face.
+    bool editBounds(const TerrainEdit &edit, int &minI, int &maxI, int &minJ, int &maxJ) {
+        // Angle from the face centre to its corners is ~54.7 degrees
+        float reach = acos(v3dot(edit.centre, faceNormal));
+        if (reach > 0.9553 + edit.radius) {
+            return false;
+        }
+
+        // Project onto the face plane (one unit out) and find grid coordinates
+        float facing = v3dot(edit.centre, faceNormal);
+        if (facing <= 0.01) {
+            return false;
+        }
+        v3 onPlane = (1.0f / facing) * edit.centre - startPt;
+
+        float u = unwarpFaceCoordinate(v3dot(onPlane, acrossDir) / v3dot(acrossDir, acrossDir));
+        float v = unwarpFaceCoordinate(v3dot(onPlane, upDir) / v3dot(upDir, upDir));
+
+        // Plane distance per radian of arc is at most |p|^2 <= 3 (face corners),
+        // and the projection can stretch that into more grid squares
+        float gridRadius = 3.0 * cubeProjectionGridStretch() * edit.radius * squaresPerSide / 2.0 + 1.0;
+
+        minI = (int)floor(u * squaresPerSide - gridRadius);
+        maxI = (int)ceil(u * squaresPerSide + gridRadius);
+        minJ = (int)floor(v * squaresPerSide - gridRadius);
+        maxJ = (int)ceil(v * squaresPerSide + gridRadius);
+
+        if (minI < 0) minI = 0;
+        if (minJ < 0) minJ = 0;
+        if (maxI > squaresPerSide) maxI = squaresPerSide;
+        if (maxJ > squaresPerSide) maxJ = squaresPerSide;
+
+        return minI <= maxI && minJ <= maxJ;
+    }
+
+    // Whether applyEdit() last recomputed this vertex's normal
+    bool inLastEdit(int index) {
+        int i = index % rowLength();
+        int j = index / rowLength();
+        return i >= editMinI && i <= editMaxI && j >= editMinJ && j <= editMaxJ;
+    }
+
+    // Returns the number of vertices changed
+    int applyEdit(const TerrainEdit &edit) {
+        int minI, maxI, minJ, maxJ;
+
+        editMinI = editMinJ = 0;
+        editMaxI = editMaxJ = -1;
+
+        if (!editBounds(edit, minI, maxI, minJ, maxJ)) {
+            return 0;
+        }
+
+        int row = rowLength();
+        float cosRadius = cos(edit.radius);
+
+        int dirtyMinI = maxI, dirtyMaxI = minI - 1;
+        int dirtyMinJ = maxJ, dirtyMaxJ = minJ - 1;
+        int changed = 0;
+
+        for (int j = minJ; j <= maxJ; ++j) {
+            for (int i = minI; i <= maxI; ++i) {
+                int index = j * row + i;
+
+                float cosAngle = v3dot(directions[index], edit.centre);
+                if (cosAngle <= cosRadius) {
+                    continue;
+                }
+
+                float t = acos(fmin(cosAngle, 1.0f)) / edit.radius;
+                float weight = (1.0 - t * t) * (1.0 - t * t);
+
+                float current = height(index);
+                float updated = current;
+
+                switch (edit.type) {
+                    case TerrainEditCrater:
+                        // Bowl with a low rim just inside the edge
+                        updated = current - edit.amount * (weight - 0.25 * sin(M_PI * t) * (1.0 - weight));
+                        break;
+
+                    case TerrainEditRaise:
+                        updated = current + edit.amount * weight;
+                        break;
+
+                    case TerrainEditFlatten:
+                        updated = current + (edit.amount - current) * weight;
+                        break;
+                }
+
+                float delta = updated - baseHeights[index];
+                if (fabs(delta) < 1.0e-6) {
+                    deltas.erase(index);
+                } else {
+                    deltas[index] = delta;
+                }
+
+                v4 col;
+                terrainVertex(directions[index], updated, radius, heightMultiplier, verts[index], col);
+                updateSurfaceHeight(index);
+
+                if (surfaceHeights[index] > maxSurfaceHeight) {
+                    maxSurfaceHeight = surfaceHeights[index];
+                }
+
+                if (i < dirtyMinI) dirtyMinI = i;
+                if (i > dirtyMaxI) dirtyMaxI = i;
+                if (j < dirtyMinJ) dirtyMinJ = j;
+                if (j > dirtyMaxJ) dirtyMaxJ = j;
+                changed += 1;
+            }
+        }
+
+        if (changed == 0) {
+            return 0;
+        }
+
+        // Neighbours of changed vertices get new normals too
+        if (dirtyMinI > 0) dirtyMinI -= 1;
+        if (dirtyMinJ > 0) dirtyMinJ -= 1;
+        if (dirtyMaxI < squaresPerSide) dirtyMaxI += 1;
+        if (dirtyMaxJ < squaresPerSide) dirtyMaxJ += 1;
+
+        computeNormals(dirtyMinI, dirtyMaxI, dirtyMinJ, dirtyMaxJ);
+
+        editMinI = dirtyMinI;
+        editMaxI = dirtyMaxI;
+        editMinJ = dirtyMinJ;
+        editMaxJ = dirtyMaxJ;
+
+        // Bounds and occluders away from the edit are still right
+        findChunkBounds(dirtyMinI, dirtyMaxI, dirtyMinJ, dirtyMaxJ);
+        findOccluders(dirtyMinI, dirtyMaxI, dirtyMinJ, dirtyMaxJ);
+
+        // One span per row, so the upload is proportional to the edited area.
+        // Evicted faces skip it - the CPU copy is up to date and goes up
+        // whole when next drawn.
+        int span = dirtyMaxI - dirtyMinI + 1;
+        for (int j = dirtyMinJ; j <= dirtyMaxJ && mesh.resident(); ++j) {
+            updateVertices(j * row + dirtyMinI, span);
+        }
+
+        return changed;
+    }
+
+    void destroy() {
+        meshCache.remove(&mesh);
+        mesh.destroy();
+
+        if (indices != NULL) {
+            releaseTerrainIndices(indices);
+            indices = NULL;
+        }
+
+        free(directions);
+        free(baseHeights);
+        free(surfaceHeights);
+        free(verts);
+        free(norms);
+
+        directions = NULL;
+        baseHeights = NULL;
+        surfaceHeights = NULL;
+        verts = NULL;
+        norms = NULL;
+
+        deltas.clear();
+    }
+};
+
+void restoreTerrainFace(Mesh *mesh, void *owner) {
+    TerrainFace *face = (TerrainFace *)owner;
+    assert(mesh == &face->mesh);
+    face->upload();
+}
+
+// Height queries work in planet-local space (planet centre at the origin)
+// and return heights above the sea level radius in world units. They read the
+// faces' cached height grids - the same surface that gets drawn, edits and
+// all - and only evaluate the noise if the terrain hasn't been built.
+struct Terrain {
+    static const int numFaces = 6;
+
+    TerrainFace faces[numFaces];
+    float radius;
+
+    FractalNoise *noise;
+    float heightMultiplier;
+
+    // Set once the faces are built and uploaded. Until then queries use the noise.
+    std::atomic<bool> ready;
+
+    // Face the last query landed on, tried first by the next one
+    int lastFace;
+
+    // Row ranges for startBuild(), and counters for its two passes
+    struct RowJob {
+        Terrain *terrain;
+        int begin;
+        int end;
+    };
+    std::vector<RowJob> rowJobs;
+    JobCounter rowsDone;
+    JobCounter normalsDone;
+    bool building;
+
+    // Vertices on more than one face (edges twice, corners three times), as
+    // face * verts per face + index, in runs: seamFirst[k] to seamFirst[k + 1]
+    std::vector<int> seamVertices;
+    std::vector<int> seamFirst;
+
+    // Face across each side of each face, in GridSide order
+    int neighbours[numFaces][numGridSides];
+
+    // Since whoever's counting last reset them
+    long trianglesDrawn;
+    long trianglesCulled;
+
+    Terrain() : ready(false) {
+        radius = 0.0;
+        noise = &terrainNoise;
+        heightMultiplier = terrainHeightMultiplier;
+        lastFace = 0;
+        building = false;
+        trianglesDrawn = 0;
+        trianglesCulled = 0;
+    }
+
+    // Rows of every face go through the job system together, `rows` at a time
+    static void generateRowsJob(void *data, int begin, int end) {
+        Terrain *terrain = (Terrain *)data;
+        int rows = terrain->faces[0].rowLength();
+
+        for (int row = begin; row < end; ++row) {
+            terrain->faces[row / rows].generateRows(row % rows, row % rows + 1);
+        }
+    }
+
+    static void computeNormalsJob(void *data, int begin, int end) {
+        Terrain *terrain = (Terrain *)data;
+        int rows = terrain->faces[0].rowLength();
+
+        for (int row = begin; row < end; ++row) {
+            TerrainFace &face = terrain->faces[row / rows];
+            face.computeNormals(0, face.squaresPerSide, row % rows, row % rows);
+        }
+    }
+
+    static void generateRowsTask(void *data) {
+        RowJob *job = (RowJob *)data;
+        generateRowsJob(job->terrain, job->begin, job->end);
+    }
+
+    static void computeNormalsTask(void *data) {
+        RowJob *job = (RowJob *)data;
+        computeNormalsJob(job->terrain, job->begin, job->end);
+    }
+
+    // Sets up the faces, ready for either build pass
+    void begin(int squaresPerSide, float _radius, FractalNoise *_noise, float _heightMultiplier) {
+        radius = _radius;
+        noise = _noise;
+        heightMultiplier = _heightMultiplier;
+
+        faces[0].begin(squaresPerSide, v3(1.0, -1.0, 1.0), v3(0.0, 2.0, 0.0), v3(0.0, 0.0, -2.0), radius, noise, heightMultiplier);
+        faces[1].begin(squaresPerSide, v3(-1.0, 1.0, 1.0), v3(0.0, -2.0, 0.0), v3(0.0, 0.0, -2.0), radius, noise, heightMultiplier);
+        faces[2].begin(squaresPerSide, v3(1.0, 1.0, 1.0), v3(-2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0), radius, noise, heightMultiplier);
+        faces[3].begin(squaresPerSide, v3(-1.0, -1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0), radius, noise, heightMultiplier);
+        faces[4].begin(squaresPerSide, v3(-1.0, 1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, -2.0, 0.0), radius, noise, heightMultiplier);
+        faces[5].begin(squaresPerSide, v3(-1.0, -1.0, -1.0), v3(2.0, 0.0, 0.0), v3(0.0, 2.0, 0.0), radius, noise, heightMultiplier);
+    }
+
+    // Groups up the copies of every vertex on a face edge. Each face only
+    // sees its own side of an edge, so this is what lets them agree.
+    void findSeams() {
+        seamVertices.clear();
+        seamFirst.clear();
+
+        int squares = faces[0].squaresPerSide;
+        int row = faces[0].rowLength();
+        int numVerts = faces[0].numVerts;
+
+        for (int f = 0; f < numFaces; ++f) {
+            TerrainFace &face = faces[f];
+
+            for (int j = 0; j <= squares; ++j) {
+                for (int i = 0; i <= squares; ++i) {
+                    if (i != 0 && i != squares && j != 0 && j != squares) {
+                        continue;
+                    }
+
+                    v3 cubePt = face.startPt + warpFaceCoordinate((float)i / squares) * face.acrossDir
+                                + warpFaceCoordinate((float)j / squares) * face.upDir;
+
+                    int first = (int)seamVertices.size();
+                    bool lowestFace = true;
+
+                    seamVertices.push_back(f * numVerts + j * row + i);
+
+                    for (int g = 0; g < numFaces && lowestFace; ++g) {
+                        if (g == f) {
+                            continue;
+                        }
+
+                        int index = faces[g].vertexAtCubePoint(cubePt);
+                        if (index < 0) {
+                            continue;
+                        }
+
+                        // Whichever face comes first keeps the group
+                        if (g < f) {
+                            lowestFace = false;
+                        }
+                        seamVertices.push_back(g * numVerts + index);
+                    }
+
+                    if (lowestFace) {
+                        seamFirst.push_back(first);
+                    } else {
+                        seamVertices.resize(first);
+                    }
+                }
+            }
+        }
+
+        seamFirst.push_back((int)seamVertices.size());
+
+        // Whoever else has the middle of each side
+        const float sideMiddles[numGridSides][2] = { {0.5, 0.0}, {1.0, 0.5}, {0.5, 1.0}, {0.0, 0.5} };
+
+        for (int f = 0; f < numFaces; ++f) {
+            TerrainFace &face = faces[f];
+
+            for (int side = 0; side < numGridSides; ++side) {
+                v3 cubePt = face.startPt + sideMiddles[side][0] * face.acrossDir + sideMiddles[side][1] * face.upDir;
+
+                neighbours[f][side] = f;
+                for (int g = 0; g < numFaces; ++g) {
+                    if (g != f && faces[g].vertexAtCubePoint(cubePt) >= 0) {
+                        neighbours[f][side] = g;
+                    }
+                }
+            }
+        }
+    }
+
+    // Gives every copy of a seam vertex the average of their normals, and the
+    // first copy's surface height. Averaging the one-sided normals from either
+    // side comes out close to a central difference across the edge; the
+    // heights only differ by rounding, but the GPU copies have to quantise the
+    // same. Resident meshes are updated if `upload` is set. Returns the number
+    // of copies changed.
+    //
+    // After an edit (`edited` set) only seams with a copy in some face's
+    // edited block are redone. Their other copies still hold the last
+    // average, not their own side's normal, so every copy is recomputed
+    // one-sided first; otherwise the untouched side would count twice.
+    int stitchSeams(bool upload, bool edited = false) {
+        int numVerts = faces[0].numVerts;
+        int changed = 0;
+
+        for (size_t k = 0; k + 1 < seamFirst.size(); ++k) {
+            if (edited) {
+                bool touched = false;
+                for (int s = seamFirst[k]; s < seamFirst[k + 1] && !touched; ++s) {
+                    int v = seamVertices[s];
+                    touched = faces[v / numVerts].inLastEdit(v % numVerts);
+                }
+                if (!touched) {
+                    continue;
+                }
+
+                for (int s = seamFirst[k]; s < seamFirst[k + 1]; ++s) {
+                    int v = seamVertices[s];
+                    TerrainFace &face = faces[v / numVerts];
+                    int i = (v % numVerts) % face.rowLength();
+                    int j = (v % numVerts) / face.rowLength();
+                    face.computeNormals(i, i, j, j);
+                }
+            }
+
+            v3 sum(0.0f, 0.0f, 0.0f);
+            for (int s = seamFirst[k]; s < seamFirst[k + 1]; ++s) {
+                int v = seamVertices[s];
+                sum = sum + faces[v / numVerts].norms[v % numVerts];
+            }
+            v3 normal = v3normalize(sum);
+
+            int owner = seamVertices[seamFirst[k]];
+            float surfaceHeight = faces[owner / numVerts].surfaceHeights[owner % numVerts];
+
+            for (int s = seamFirst[k]; s < seamFirst[k + 1]; ++s) {
+                int v = seamVertices[s];
+                TerrainFace &face = faces[v / numVerts];
+                int index = v % numVerts;
+
+                if (v3dot(face.norms[index] - normal, face.norms[index] - normal) < 1.0e-12 &&
+                    face.surfaceHeights[index] == surfaceHeight) {
+                    continue;
+                }
+
+                face.norms[index] = normal;
+                face.surfaceHeights[index] = surfaceHeight;
+                changed += 1;
+
+                if (upload) {
+                    face.updateVertices(index, 1);
+                }
+            }
+        }
+
+        return changed;
+    }
+
+    void finish() {
+        findSeams();
+        stitchSeams(false);
+
+        // Room for edits to build up about as high again before the GPU
+        // copy clips them
+        float highest = 0.0;
+        for (int i = 0; i < numFaces; ++i) {
+            highest = fmax(highest, faces[i].findMaxSurfaceHeight());
+        }
+        float heightRange = 2.0 * highest + 1.0;
+
+        for (int i = 0; i < numFaces; ++i) {
+            faces[i].finish(heightRange);
+        }
+        ready = true;
+
+        reportVertexPacking();
+    }
+
+    // Worst difference between the vertices as built and as the GPU will
+    // decode them
+    void reportVertexPacking() {
+        float worstPosition = 0.0;
+        float worstNormal = 0.0;
+
+        for (int f = 0; f < numFaces; ++f) {
+            TerrainFace &face = faces[f];
+
+            for (int i = 0; i < face.numVerts; ++i) {
+                TerrainVertex packed;
+                face.packVertices(i, 1, &packed);
+
+                v3 pt, normal;
+                face.decodeVertex(i, packed, pt, normal);
+
+                worstPosition = fmax(worstPosition, v3length(pt - face.verts[i]));
+                // From the chord, acos can't resolve angles this small
+                worstNormal = fmax(worstNormal, 2.0 * asin(fmin(0.5 * v3length(normal - face.norms[i]), 1.0f)));
+            }
+        }
+
+        float heightStep = faces[0].heightRange / 65535.0;
+
+        printf("Terrain vertices: %d bytes (from %d), height step %.4f, worst position error %.4f (%.4f%% of a square), normal %.3f degrees\n",
+               (int)sizeof(TerrainVertex), (int)(sizeof(v3) + sizeof(uint32_t) + sizeof(v4)), heightStep, worstPosition,
+               100.0 * worstPosition * faces[0].squaresPerSide / (2.0 * radius), worstNormal * 180.0 / M_PI);
+    }
+
+    void build(int squaresPerSide, float _radius, FractalNoise *_noise = &terrainNoise,
+               float _heightMultiplier = terrainHeightMultiplier) {
+        begin(squaresPerSide, _radius, _noise, _heightMultiplier);
+
+        int totalRows = numFaces * faces[0].rowLength();
+
+        // Normals read the neighbouring rows, so they wait for every vertex
+        jobs.parallelFor(totalRows, 4, generateRowsJob, this);
+        jobs.parallelFor(totalRows, 4, computeNormalsJob, this);
+
+        finish();
+    }
+
+    // Same as build() without waiting: queues the work and returns. Call
+    // pollBuild() once a frame (on the GL thread) to upload it when it's done.
+    void startBuild(int squaresPerSide, float _radius, FractalNoise *_noise, float _heightMultiplier) {
+        begin(squaresPerSide, _radius, _noise, _heightMultiplier);
+
+        const int grain = 4;
+        int totalRows = numFaces * faces[0].rowLength();
+        int numJobs = (totalRows + grain - 1) / grain;
+
+        rowJobs.resize(numJobs);
+        for (int i = 0; i < numJobs; ++i) {
+            rowJobs[i].terrain = this;
+            rowJobs[i].begin = i * grain;
+            rowJobs[i].end = rowJobs[i].begin + grain < totalRows ? rowJobs[i].begin + grain : totalRows;
+        }
+
+        building = true;
+
+        for (int i = 0; i < numJobs; ++i) {
+            jobs.submit(generateRowsTask, &rowJobs[i], &rowsDone);
+        }
+        for (int i = 0; i < numJobs; ++i) {
+            jobs.submit(computeNormalsTask, &rowJobs[i], &normalsDone, &rowsDone);
+        }
+    }
+
+    // Returns true once the terrain is ready to draw
+    bool pollBuild() {
+        if (ready) {
+            return true;
+        }
+        if (!building) {
+            return false;
+        }
+
+        // Nobody else to run the jobs
+        if (jobs.numWorkers == 1) {
+            jobs.wait(normalsDone);
+        }
+
+        if (normalsDone.count > 0) {
+            return false;
+        }
+
+        // Let the last job let go of the counter
+        jobs.wait(normalsDone);
+
+        building = false;
+        rowJobs.clear();
+        finish();
+
+        return true;
+    }
+
+    // Height of the generated terrain (no edits) from the full noise
+    float exactHeightAt(const v3 &dir) {
+        v3 unitDir = v3normalize(dir);
+        v3 pt;
+        v4 col;
+
+        terrainVertex(unitDir, normalizedHeightAboveSeaLevel(*noise, unitDir), radius, heightMultiplier, pt, col);
+
+        return v3length(pt) - radius;
+    }
+
+    float heightAt(const v3 &dir) {
+        float u, v;
+
+        if (!ready) {
+            return exactHeightAt(dir);
+        }
+
+        if (faces[lastFace].surfaceHeights && faces[lastFace].faceCoordinates(dir, u, v)) {
+            return faces[lastFace].sampleHeight(u, v);
+        }
+
+        for (int i = 0; i < numFaces; ++i) {
+            if (i != lastFace && faces[i].surfaceHeights && faces[i].faceCoordinates(dir, u, v)) {
+                lastFace = i;
+                return faces[i].sampleHeight(u, v);
+            }
+        }
+
+        return exactHeightAt(dir);
+    }
+
+    // Batch form; nearby probes mostly share a face so the face test stays cheap
+    void heightsAt(const v3 *dirs, float *heights, int count) {
+        for (int i = 0; i < count; ++i) {
+            heights[i] = heightAt(dirs[i]);
+        }
+    }
+
+    // Distance from the planet centre to the ground in direction `dir`
+    float surfaceRadiusAt(const v3 &dir) {
+        return radius + heightAt(dir);
+    }
+
+    float maxSurfaceHeight() {
+        // Not built yet, so all we know is how high the noise can go
+        if (!ready) {
+            return radius * heightMultiplier * (noise->maxValue() - terrainSeaLevel);
+        }
+
+        float result = 0.0;
+        for (int i = 0; i < numFaces; ++i) {
+            if (faces[i].maxSurfaceHeight > result) {
+                result = faces[i].maxSurfaceHeight;
+            }
+        }
+        return result;
+    }
+
+    // First point where the ray from `origin` along `dir` meets the ground,
+    // within `maxDistance`. Marches through the shell the terrain lives in,
+    // taking smaller steps the closer it gets, then bisects the crossing.
+    bool raycastTerrain(const v3 &origin, const v3 &dir, float maxDistance, v3 &hit) {
+        v3 unitDir = v3normalize(dir);
+
+        float outerRadius = radius + maxSurfaceHeight() + 1.0;
+
+        // Clip the ray to the outer sphere
+        float b = v3dot(origin, unitDir);
+        float c = v3dot(origin, origin) - outerRadius * outerRadius;
+        float discriminant = b * b - c;
+        if (discriminant < 0.0) {
+            return false;
+        }
+
+        float root = sqrt(discriminant);
+        float tNear = -b - root;
+        float tFar = -b + root;
+
+        if (tNear < 0.0) tNear = 0.0;
+        if (tFar > maxDistance) tFar = maxDistance;
+        if (tNear > tFar) {
+            return false;
+        }
+
+        // Grid spacing in world units, roughly
+        int squaresPerSide = faces[0].squaresPerSide > 0 ? faces[0].squaresPerSide : 128;
+        float spacing = 2.0 * radius / squaresPerSide;
+        float minStep = 0.0625 * spacing;
+        float maxStep = 0.5 * spacing;
+
+        float tPrev = tNear;
+        float t = tNear;
+
+        while (t <= tFar) {
+            v3 pt = origin + t * unitDir;
+            float altitude = v3length(pt) - surfaceRadiusAt(pt);
+
+            if (altitude <= 0.0) {
+                if (t == tNear) {
+                    hit = pt;
+                    return true;
+                }
+
+                // Crossing lies between tPrev (above) and t (below)
+                float above = tPrev;
+                float below = t;
+                for (int i = 0; i < 12; ++i) {
+                    float mid = 0.5 * (above + below);
+                    v3 midPt = origin + mid * unitDir;
+
+                    if (v3length(midPt) > surfaceRadiusAt(midPt)) {
+                        above = mid;
+                    } else {
+                        below = mid;
+                    }
+                }
+
+                hit = origin + below * unitDir;
+                return true;
+            }
+
+            float step = 0.5 * altitude;
+            if (step < minStep) step = minStep;
+            if (step > maxStep) step = maxStep;
+
+            tPrev = t;
+            t += step;
+        }
+
+        return false;
+    }
+
+    // Faces that could be in view from `cameraPos` (planet-local). A point at
+    // radius r shows over the horizon if it's within acos(R / d) + acos(R / r)
+    // of the camera's direction; a face reaches ~54.7 degrees from its centre.
+    void visibleFaces(const v3 &cameraPos, bool *visible) {
+        float distance = v3length(cameraPos);
+        v3 towardsCamera = distance > 0.0 ? (1.0f / distance) * cameraPos : v3(0.0f, 0.0f, 1.0f);
+
+        float horizon = acos(distance > radius ? radius / distance : 1.0f) +
+                        acos(radius / (radius + maxSurfaceHeight()));
+
+        for (int i = 0; i < numFaces; ++i) {
+            float angle = acos(fmax(fmin(v3dot(faces[i].faceNormal, towardsCamera), 1.0f), -1.0f));
+            visible[i] = angle <= horizon + 0.9553;
+        }
+    }
+
+    // Level of detail for each face (see TerrainIndices) from `cameraPos`
+    // (planet-local). Faces whose nearest corner is well round the curve
+    // from the point under the camera only get every other vertex.
+    void faceLevels(const v3 &cameraPos, int *levels) {
+        const float coarseAngle = 0.35;
+
+        float distance = v3length(cameraPos);
+        v3 towardsCamera = distance > 0.0 ? (1.0f / distance) * cameraPos : v3(0.0f, 0.0f, 1.0f);
+
+        for (int i = 0; i < numFaces; ++i) {
+            float angle = acos(fmax(fmin(v3dot(faces[i].faceNormal, towardsCamera), 1.0f), -1.0f));
+            levels[i] = angle - 0.9553 > coarseAngle && faces[i].squaresPerSide % 2 == 0 ? 1 : 0;
+        }
+    }
+
+    // Sea level radius, height of the top of the packed range, squares per
+    // side and whether the grid is tangent warped, for TerrainVertex.glsl
+    void setShapeUniform(const TerrainUniforms &uniforms) {
+        glUniform4f(uniforms.shape, radius, faces[0].heightRange, faces[0].squaresPerSide,
+                    cubeProjection == CubeProjectionTangent ? 1.0 : 0.0);
+    }
+
+    // Stand-ins for every face in `faceVisible`, see TerrainFace::drawOccluders()
+    void drawOccluders(OcclusionBuffer &buffer, const v3 &offset, const bool *faceVisible) {
+        for (int i = 0; i < numFaces; ++i) {
+            if (faceVisible[i]) {
+                faces[i].drawOccluders(buffer, offset);
+            }
+        }
+    }
+
+    // Unhidden chunks of each face in `faceVisible` (none of the others)
+    void testChunks(OcclusionBuffer &buffer, const v3 &offset, const bool *faceVisible, uint64_t *chunkVisible) {
+        for (int i = 0; i < numFaces; ++i) {
+            chunkVisible[i] = faceVisible[i] ? faces[i].testChunks(buffer, offset) : 0;
+        }
+    }
+
+    // Face `face` at its level in `levels`, its sides stitched to any coarser
+    // neighbours, just the chunks in `chunks`
+    void drawFace(int face, const int *levels, uint64_t chunks, const TerrainUniforms &uniforms) {
+        int stitchedSides = 0;
+
+        if (levels[face] == 0) {
+            for (int side = 0; side < numGridSides; ++side) {
+                if (levels[neighbours[face][side]] > 0) {
+                    stitchedSides |= 1 << side;
+                }
+            }
+        }
+
+        faces[face].setUniforms(uniforms);
+        faces[face].draw(levels[face], stitchedSides, chunks, trianglesDrawn, trianglesCulled);
+    }
+
+    // Returns the number of vertices changed across all faces
+    int applyEdit(const TerrainEdit &edit) {
+        if (!ready) {
+            return 0;
+        }
+
+        int changed = 0;
+        for (int i = 0; i < numFaces; ++i) {
+            changed += faces[i].applyEdit(edit);
+        }
+
+        // Edits near an edge leave each side with its own normals again
+        if (changed > 0) {
+            stitchSeams(true, true);
+        }
+
+        return changed;
+    }
+
+    int crater(const v3 &centre, float radius, float depth) {
+        TerrainEdit edit = { TerrainEditCrater, v3normalize(centre), radius, depth };
+        return applyEdit(edit);
+    }
+
+    int raise(const v3 &centre, float radius, float amount) {
+        TerrainEdit edit = { TerrainEditRaise, v3normalize(centre), radius, amount };
+        return applyEdit(edit);
+    }
+
+    int flatten(const v3 &centre, float radius, float targetHeight) {
+        TerrainEdit edit = { TerrainEditFlatten, v3normalize(centre), radius, targetHeight };
+        return applyEdit(edit);
+    }
+
+    void destroy() {
+        // Jobs still running would write into the freed arrays
+        if (building) {
+            jobs.wait(normalsDone);
+            building = false;
+            rowJobs.clear();
+        }
+
+        for (int i = 0; i < numFaces; ++i) {
+            faces[i].destroy();
+        }
+        seamVertices.clear();
+        seamFirst.clear();
+        ready = false;
+    }
+};
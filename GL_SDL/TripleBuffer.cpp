@@ -0,0 +1,61 @@
+//
+//  TripleBuffer.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Lock-free hand-off of the latest value from one thread to another.
+//
+// The writer fills its own slot and publishes it by swapping it with the
+// shared middle slot; the reader swaps its slot with the middle one when
+// there's something newer there. Neither side ever waits, the reader just
+// keeps using what it has, and values the reader never got round to are
+// overwritten.
+
+#include <atomic>
+
+template <typename T>
+struct TripleBuffer {
+    static const int indexMask = 3;
+    static const int freshBit = 4;
+
+    T slots[3];
+
+    // Index of the middle slot, plus freshBit if the reader hasn't seen it
+    std::atomic<int> shared;
+
+    int writeIndex;     // Only touched by the writer
+    int readIndex;      // Only touched by the reader
+
+    TripleBuffer() : shared(1) {
+        writeIndex = 0;
+        readIndex = 2;
+    }
+
+    T &writeSlot() {
+        return slots[writeIndex];
+    }
+
+    void publish() {
+        int previous = shared.exchange(writeIndex | freshBit, std::memory_order_acq_rel);
+        writeIndex = previous & indexMask;
+    }
+
+    // Picks up the newest published value, if there is one
+    bool acquire() {
+        if ((shared.load(std::memory_order_acquire) & freshBit) == 0) {
+            return false;
+        }
+
+        int previous = shared.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & indexMask;
+
+        return true;
+    }
+
+    const T &readSlot() {
+        return slots[readIndex];
+    }
+};
@@ -0,0 +1,366 @@
+//
+//  VertexCache.cpp
+//  GL_SDL
+//
+//  Created by George Sealy on 19/10/26.
+//  Copyright © 2026 MixBit. All rights reserved.
+//
+
+// Index orderings for the post-transform vertex cache.
+//
+// The GPU keeps the last few transformed vertices and reuses them when an
+// index comes round again, so the order triangles are drawn in decides how
+// often the vertex shader runs. Two measures of it:
+//   ACMR - vertex shader runs per triangle (0.5 is ideal on a big grid, 3 the worst)
+//   ATVR - vertex shader runs per vertex (1 is ideal)
+//
+// Real caches differ from GPU to GPU (and newer ones batch rather than keep
+// a FIFO), so everything here is judged against a modelled FIFO. Orderings
+// tuned for a small cache still do fine on a bigger one; the other way
+// round they thrash.
+//
+// Grids get a fixed ordering (vertical stripes, see buildGridTriangleIndices),
+// anything else can go through Tipsify (Sander, Nehab & Barczak 2007), which
+// is linear time and doesn't need to know the cache size exactly.
+
+#include <vector>
+
+// Entries in the modelled FIFO. Conservative, most GPUs hold more.
+const int vertexCacheSize = 16;
+
+// Serpentine triangle strip over a (squaresPerSide + 1)^2 grid of vertices
+ushort *buildGridStripIndices(int squaresPerSide, int *numIndices) {
+
+    *numIndices = (2 * (squaresPerSide + 1)) * squaresPerSide;
+    ushort *indices = (ushort *)malloc(sizeof(ushort) * *numIndices);
+
+    int index = 0;
+
+    for (int j = 0; j < squaresPerSide; ++j) {
+        for (int i = 0; i <= squaresPerSide; ++i) {
+
+            if ((j % 2) == 0) {
+
+                ushort baseIndex = j * (squaresPerSide + 1) + i;
+
+                indices[index + 0] = baseIndex;
+                indices[index + 1] = baseIndex + (squaresPerSide + 1);
+
+            } else {
+
+                ushort baseIndex = j * (squaresPerSide + 1) + (squaresPerSide - i);
+
+                indices[index + 0] = baseIndex + (squaresPerSide + 1);
+                indices[index + 1] = baseIndex;
+
+            }
+
+            index += 2;
+        }
+    }
+
+    return indices;
+}
+
+// Sides of a grid, as bits of a stitching mask
+typedef enum {
+    GridSideBottom = 1,         // j = 0
+    GridSideRight = 2,          // i = squaresPerSide
+    GridSideTop = 4,            // j = squaresPerSide
+    GridSideLeft = 8,           // i = 0
+} GridSide;
+
+const int numGridSides = 4;
+const int numGridStitchMasks = 1 << numGridSides;
+
+// Where grid vertex (i, j) ends up with `stitchedSides` matched to a half
+// resolution neighbour: odd vertices along those sides fold onto the even
+// one before them, so the side only has the neighbour's vertices on it
+inline int stitchedGridVertex(int squaresPerSide, int stitchedSides, int i, int j) {
+    if ((i & 1) && ((j == 0 && (stitchedSides & GridSideBottom)) || (j == squaresPerSide && (stitchedSides & GridSideTop)))) {
+        i -= 1;
+    }
+    if ((j & 1) && ((i == 0 && (stitchedSides & GridSideLeft)) || (i == squaresPerSide && (stitchedSides & GridSideRight)))) {
+        j -= 1;
+    }
+    return j * (squaresPerSide + 1) + i;
+}
+
+// Grid square where chunk column (or row) `k` of `chunksPerSide` starts;
+// k = chunksPerSide gives the far edge. Kept even, so a grid drawn with a
+// step of 2 splits into the same chunks.
+inline int gridChunkStart(int squaresPerSide, int chunksPerSide, int k) {
+    if (k >= chunksPerSide) {
+        return squaresPerSide;
+    }
+    return 2 * ((k * (squaresPerSide / 2)) / chunksPerSide);
+}
+
+// Triangle list over a (squaresPerSide + 1)^2 grid of vertices, with the
+// same winding as buildGridStripIndices. Squares go row by row up vertical
+// stripes just narrow enough that the row below is still cached when the
+// row above gets to it, so (stripe edges aside) every vertex is transformed
+// once and each row of squares only costs its new top row.
+//
+// A `step` of 2 uses every other vertex (squaresPerSide has to be even).
+// `stitchedSides` folds the full grid's edges down to meet a neighbour
+// drawn that way without cracks; the triangles that collapse are dropped.
+//
+// With `chunksPerSide` above 1 the grid is split into that many chunks
+// each way (see gridChunkStart), striped separately and listed one after
+// the other, row by row, so any chunk can be drawn on its own. Chunk c
+// starts at index chunkFirst[c]; chunkFirst needs chunksPerSide^2 + 1 entries.
+ushort *buildGridTriangleIndices(int squaresPerSide, int *numIndices, int cacheSize = vertexCacheSize,
+                                 int step = 1, int stitchedSides = 0, int chunksPerSide = 1,
+                                 int *chunkFirst = NULL) {
+
+    // A FIFO goes by when vertices were loaded, not last used, so the row
+    // below only leaves once the row above has pushed it out: two rows of
+    // the stripe have to fit
+    int stripe = cacheSize / 2 - 1;
+    if (stripe < 1) {
+        stripe = 1;
+    }
+
+    int squares = squaresPerSide / step;
+    ushort *indices = (ushort *)malloc(sizeof(ushort) * 6 * squares * squares);
+
+    int index = 0;
+
+    for (int chunk = 0; chunk < chunksPerSide * chunksPerSide; ++chunk) {
+        int chunkI = chunk % chunksPerSide;
+        int chunkJ = chunk / chunksPerSide;
+
+        int minI = gridChunkStart(squaresPerSide, chunksPerSide, chunkI) / step;
+        int endI = gridChunkStart(squaresPerSide, chunksPerSide, chunkI + 1) / step;
+        int minJ = gridChunkStart(squaresPerSide, chunksPerSide, chunkJ) / step;
+        int endJ = gridChunkStart(squaresPerSide, chunksPerSide, chunkJ + 1) / step;
+
+        if (chunkFirst != NULL) {
+            chunkFirst[chunk] = index;
+        }
+
+        for (int first = minI; first < endI; first += stripe) {
+            int last = first + stripe < endI ? first + stripe : endI;
+
+            for (int j = minJ; j < endJ; ++j) {
+                for (int i = first; i < last; ++i) {
+                    int i0 = i * step, i1 = i0 + step;
+                    int j0 = j * step, j1 = j0 + step;
+
+                    ushort a = stitchedGridVertex(squaresPerSide, stitchedSides, i0, j0);
+                    ushort b = stitchedGridVertex(squaresPerSide, stitchedSides, i1, j0);
+                    ushort c = stitchedGridVertex(squaresPerSide, stitchedSides, i0, j1);
+                    ushort d = stitchedGridVertex(squaresPerSide, stitchedSides, i1, j1);
+
+                    if (a != b && a != c) {
+                        indices[index + 0] = a;
+                        indices[index + 1] = c;
+                        indices[index + 2] = b;
+                        index += 3;
+                    }
+
+                    if (b != c && b != d && c != d) {
+                        indices[index + 0] = b;
+                        indices[index + 1] = c;
+                        indices[index + 2] = d;
+                        index += 3;
+                    }
+                }
+            }
+        }
+    }
+
+    if (chunkFirst != NULL) {
+        chunkFirst[chunksPerSide * chunksPerSide] = index;
+    }
+
+    *numIndices = index;
+    return indices;
+}
+
+// Reorders a triangle list (in place) for the vertex cache
+void tipsifyIndices(ushort *indices, int numIndices, int numVerts, int cacheSize = vertexCacheSize) {
+    int numTriangles = numIndices / 3;
+
+    // Triangles using each vertex
+    std::vector<int> live(numVerts, 0);
+    for (int i = 0; i < numIndices; ++i) {
+        live[indices[i]] += 1;
+    }
+
+    std::vector<int> firstTriangle(numVerts + 1, 0);
+    for (int v = 0; v < numVerts; ++v) {
+        firstTriangle[v + 1] = firstTriangle[v] + live[v];
+    }
+
+    std::vector<int> triangles(numIndices);
+    std::vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (int i = 0; i < numIndices; ++i) {
+        triangles[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cacheTime(numVerts, 0);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<int> deadEnd;
+    std::vector<int> candidates;
+    std::vector<ushort> result;
+    result.reserve(numIndices);
+
+    int time = cacheSize + 1;
+    int cursor = 0;
+    int fan = 0;
+
+    while (fan >= 0) {
+        candidates.clear();
+
+        // Everything left around the fanning vertex
+        for (int t = firstTriangle[fan]; t < firstTriangle[fan + 1]; ++t) {
+            int triangle = triangles[t];
+            if (emitted[triangle]) {
+                continue;
+            }
+
+            for (int k = 0; k < 3; ++k) {
+                int v = indices[3 * triangle + k];
+
+                result.push_back((ushort)v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v] -= 1;
+
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time;
+                    time += 1;
+                }
+            }
+
+            emitted[triangle] = true;
+        }
+
+        // Next fan from whichever candidate will still be cached once its
+        // own triangles are done, oldest first
+        int next = -1;
+        int best = -1;
+
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            int v = candidates[c];
+            if (live[v] <= 0) {
+                continue;
+            }
+
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+
+        // Otherwise back through recent vertices, then on through the input
+        while (next < 0 && !deadEnd.empty()) {
+            int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0) {
+                next = v;
+            }
+        }
+
+        while (next < 0 && cursor < numVerts) {
+            if (live[cursor] > 0) {
+                next = cursor;
+            }
+            cursor += 1;
+        }
+
+        fan = next;
+    }
+
+    memcpy(indices, &result[0], sizeof(ushort) * numIndices);
+}
+
+struct VertexCacheStats {
+    int triangles;
+    int vertices;
+    int transforms;     // Vertex shader runs
+    float acmr;
+    float atvr;
+};
+
+// Runs the index list (or strip) through a FIFO cache of `cacheSize`
+VertexCacheStats measureVertexCache(const ushort *indices, int numIndices, int numVerts, bool strip,
+                                    int cacheSize = vertexCacheSize) {
+    VertexCacheStats stats;
+    stats.vertices = numVerts;
+    stats.transforms = 0;
+
+    if (strip) {
+        // Turn-arounds are still triangles as far as the GPU is concerned
+        // unless they repeat an index
+        stats.triangles = 0;
+        for (int i = 2; i < numIndices; ++i) {
+            ushort a = indices[i - 2], b = indices[i - 1], c = indices[i];
+            if (a != b && b != c && a != c) {
+                stats.triangles += 1;
+            }
+        }
+    } else {
+        stats.triangles = numIndices / 3;
+    }
+
+    // A vertex is cached if fewer than cacheSize misses have happened since its own
+    std::vector<int> loaded(numVerts, -cacheSize - 1);
+
+    for (int i = 0; i < numIndices; ++i) {
+        int v = indices[i];
+        if (stats.transforms - loaded[v] >= cacheSize) {
+            loaded[v] = stats.transforms;
+            stats.transforms += 1;
+        }
+    }
+
+    stats.acmr = stats.triangles > 0 ? (float)stats.transforms / stats.triangles : 0.0;
+    stats.atvr = numVerts > 0 ? (float)stats.transforms / numVerts : 0.0;
+
+    return stats;
+}
+
+void printVertexCacheStats(const char *name, const VertexCacheStats &stats) {
+    printf("  %-16s %7d triangles, %7d vertex shader runs, ACMR %.3f, ATVR %.3f\n",
+           name, stats.triangles, stats.transforms, stats.acmr, stats.atvr);
+}
+
+// Compares the ways a terrain face could be indexed, at the caches we're
+// likely to meet, including what splitting it into chunks costs
+void reportGridVertexCache(int squaresPerSide, int chunksPerSide = 1) {
+    int numVerts = (squaresPerSide + 1) * (squaresPerSide + 1);
+
+    int numStrip, numBlocked, numChunked, numTipsified;
+    ushort *strip = buildGridStripIndices(squaresPerSide, &numStrip);
+    ushort *blocked = buildGridTriangleIndices(squaresPerSide, &numBlocked);
+    ushort *chunked = buildGridTriangleIndices(squaresPerSide, &numChunked, vertexCacheSize, 1, 0, chunksPerSide);
+
+    // Tipsify starting from plain rows, to check the stripes against
+    ushort *tipsified = buildGridTriangleIndices(squaresPerSide, &numTipsified, 2 * (squaresPerSide + 1));
+    tipsifyIndices(tipsified, numTipsified, numVerts);
+
+    const int cacheSizes[2] = { vertexCacheSize, 2 * vertexCacheSize };
+
+    for (int c = 0; c < 2; ++c) {
+        printf("Vertex cache (%d entry FIFO), %d squares/side face:\n", cacheSizes[c], squaresPerSide);
+        printVertexCacheStats("strip", measureVertexCache(strip, numStrip, numVerts, true, cacheSizes[c]));
+        printVertexCacheStats("stripes", measureVertexCache(blocked, numBlocked, numVerts, false, cacheSizes[c]));
+        if (chunksPerSide > 1) {
+            printVertexCacheStats("chunked stripes", measureVertexCache(chunked, numChunked, numVerts, false, cacheSizes[c]));
+        }
+        printVertexCacheStats("tipsify", measureVertexCache(tipsified, numTipsified, numVerts, false, cacheSizes[c]));
+    }
+
+    free(strip);
+    free(blocked);
+    free(chunked);
+    free(tipsified);
+}
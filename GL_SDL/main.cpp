@@ -20,9 +20,27 @@
 
 #include "Maths.cpp"
 #include "Utils.cpp"
+#include "Jobs.cpp"
+#include "Stats.cpp"
+#include "TripleBuffer.cpp"
 #include "GLUtils.cpp"
+#include "GpuMemory.cpp"
+#include "Shaders.cpp"
 #include "Mesh.cpp"
+#include "StreamBuffer.cpp"
+#include "DebugDraw.cpp"
 #include "Noise.cpp"
+#include "Fractal.cpp"
+#include "CubeSphere.cpp"
+#include "VertexCache.cpp"
+#include "Occlusion.cpp"
+#include "Terrain.cpp"
+#include "Atmosphere.cpp"
+#include "Stars.cpp"
+#include "Rings.cpp"
+#include "Orbits.cpp"
+#include "Bodies.cpp"
+#include "Asteroids.cpp"
 
 #define PROGRAM_NAME "GL Skeleton"
 const float planetRadius = 6000.0;
@@ -51,260 +69,111 @@ void checkSDLError(int line = -1)
 #endif
 }
 
-GLuint vertexShader = 0;
-GLuint geometryShader = 0;
-GLuint fragmentShader = 0;
-GLuint shaderProgram = 0;
+ShaderManager shaders;
+ShaderHandle cameraShader = InvalidShader;
+FrameConstantsBuffer frameConstants;
+DebugDraw debugDraw;
 
-inline float normalizedHeightAboveSeaLevel(const v3 &basePt) {
-    v3 pt = v3normalize(basePt);
-    
-    double n = noise(4.0 * pt.x, 4.0 * pt.y, 4.0 * pt.z);
-    double n2 = noise(7.0 * pt.x, 7.0 * pt.y, 7.0 * pt.z);
-    
-    float height = n + 0.5 * n2;
-    
-    return height;
-}
+Bodies bodies;
+Stars stars;
+Rings rings;
+AsteroidField asteroids;
 
-Mesh buildGridMesh(int squaresPerSide, v3 startPt, v3 acrossDir, v3 upDir) {
-    
-    float scaleFactor = 1.0 / squaresPerSide;
+// `report` runs the measurements behind the startup numbers and prints them
+void setupGL(bool report) {
     
-    v3 uStep = scaleFactor * acrossDir;
-    v3 vStep = scaleFactor * upDir;
+    // Matches the longest edge of the original 128 square gnomonic grid
+    int numSquaresPerSide = cubeProjectionSquaresPerSide();
     
-    int numVerts = (squaresPerSide + 1) * (squaresPerSide + 1);
-
-    v3 *verts = (v3 *)malloc(sizeof(v3) * numVerts);
-    v3 *norms = (v3 *)malloc(sizeof(v3) * numVerts);
-    v4 *cols = (v4 *)malloc(sizeof(v4) * numVerts);
-
-    int vertIndex = 0;
-    for (int j = 0; j <= squaresPerSide; ++j) {
+    if (report) {
+        CubeProjectionStats reference = measureCubeProjection(CubeProjectionGnomonic, 128);
+        int matching = cubeProjectionSquaresForMaxEdge(cubeProjection, reference.maxEdge);
+        matching += matching % 2;
         
-        for (int i = 0; i <= squaresPerSide; ++i) {
-            
-            v3 &pt = verts[vertIndex];
-            
-            v3 u = i * uStep;
-            v3 v = j * vStep;
-
-            pt = startPt + u + v;
-
-//            // TODO: (George) Move the normalisation / height code out of here into a separate function
-//            // TODO: (George) Will require an "update mesh" function and stored arrays in mesh struct
-            pt = v3normalize(pt);
-            
-            float height = normalizedHeightAboveSeaLevel(pt);
-            
-            height += 0.1;
-            
-            double multiplier = 0.025;
-            float distFromCentre = planetRadius * (1.0 + height * multiplier);
-            
-            if (height < 0.0) {
-                distFromCentre = planetRadius;
-            }
-            
-            pt = distFromCentre * pt;
-            
-            if (height < 0.0) {
-                cols[vertIndex].r = 0.2;
-                cols[vertIndex].g = 0.2 - height * 0.5;
-                cols[vertIndex].b = 1.0;
-            } else if (height < 0.8) {
-                cols[vertIndex].r = 0.2 + 0.4 * height;
-                cols[vertIndex].g = 0.5;
-                cols[vertIndex].b = 0.1 + 0.4 * height;
-            } else {
-                cols[vertIndex].r = 0.9;
-                cols[vertIndex].g = 0.9;
-                cols[vertIndex].b = 0.9;
-            }
-            cols[vertIndex].a = 1.0;
-            
-            vertIndex += 1;
-        }
-    }
-    
-    int numIndices = (2 * (squaresPerSide + 1)) * squaresPerSide;
-    ushort *indices = (ushort *)malloc(sizeof(ushort) * numIndices);
-
-    int index = 0;
-    
-    for (int j = 0; j < squaresPerSide; ++j) {
-        for (int i = 0; i <= squaresPerSide; ++i) {
-            
-            if ((j % 2) == 0) {
-                
-                ushort baseIndex = j * (squaresPerSide + 1) + i;
-                
-                indices[index + 0] = baseIndex;
-                indices[index + 1] = baseIndex + (squaresPerSide + 1);
-                
-            } else {
-                
-                ushort baseIndex = j * (squaresPerSide + 1) + (squaresPerSide - i);
-                
-                indices[index + 0] = baseIndex + (squaresPerSide + 1);
-                indices[index + 1] = baseIndex;
-                
-            }
-            
-            index += 2;
+        printCubeProjectionStats(reference);
+        printCubeProjectionStats(measureCubeProjection(cubeProjection, numSquaresPerSide));
+        
+        if (matching != numSquaresPerSide) {
+            printf("Cube projection: %d squares/side now matches the reference, not %d\n", matching, numSquaresPerSide);
         }
+        
+        reportGridVertexCache(numSquaresPerSide, terrainChunksPerSide);
     }
     
-    Mesh result;
-    
-    result.setup(numVerts, verts, norms, cols, numIndices, indices);
-    
-    free(verts);
-    free(cols);
-    free(indices);
-    
-    return result;
-}
-
-Mesh buildAtmosphereMesh(int squaresPerSide, v3 startPt, v3 acrossDir, v3 upDir) {
-    
-    float scaleFactor = 1.0 / squaresPerSide;
+    // Terrain meshes over this get evicted, least recently drawn first
+    gpuMemory.budget = 128 * 1024 * 1024;
     
-    v3 uStep = scaleFactor * acrossDir;
-    v3 vStep = scaleFactor * upDir;
+    terrainNoise.setup(FractalTypeFBm, 2, 4.0, 1.75, 0.5, &planetNoise);
     
-    int numVerts = (squaresPerSide + 1) * (squaresPerSide + 1);
+    double topFrequency = terrainNoise.frequencies[terrainNoise.numOctaves - 1];
+    terrainNoiseAccuracy = recordedNoiseAccuracy(topFrequency);
     
-    v3 *verts = (v3 *)malloc(sizeof(v3) * numVerts);
-    v3 *norms = (v3 *)malloc(sizeof(v3) * numVerts);
-    v4 *cols = (v4 *)malloc(sizeof(v4) * numVerts);
-    
-    int vertIndex = 0;
-    for (int j = 0; j <= squaresPerSide; ++j) {
-        
-        for (int i = 0; i <= squaresPerSide; ++i) {
-            
-            v3 &pt = verts[vertIndex];
-            
-            v3 u = i * uStep;
-            v3 v = j * vStep;
-            
-            pt = startPt + u + v;
-            
-            //            // TODO: (George) Move the normalisation / height code out of here into a separate function
-            //            // TODO: (George) Will require an "update mesh" function and stored arrays in mesh struct
-            pt = v3normalize(pt);
-            
-            float height = 5.0;
-            
-            double multiplier = 0.025;
-            float distFromCentre = planetRadius * (1.0 + height * multiplier);
-            
-            pt = distFromCentre * pt;
-            cols[vertIndex].r = 0.7;
-            cols[vertIndex].g = 0.75;
-            cols[vertIndex].b = 0.9;
-            cols[vertIndex].a = 0.3;
-            
-            vertIndex += 1;
-        }
+    if (report) {
+        terrainNoiseAccuracy = measureNoiseAccuracy(planetNoise, topFrequency, 4096);
+        printNoiseAccuracy(terrainNoiseAccuracy);
+        printNoiseSpeed(measureNoiseSpeed(planetNoise, topFrequency, 65536));
+        printOctaveSkipping(measureOctaveSkipping(terrainNoise, terrainNoiseTolerance, terrainSeaLevel, 4096));
     }
     
-    int numIndices = (2 * (squaresPerSide + 1)) * squaresPerSide;
-    ushort *indices = (ushort *)malloc(sizeof(ushort) * numIndices);
+    jobs.init();
     
-    int index = 0;
+    shaders.init("ShaderCache");
     
-    for (int j = 0; j < squaresPerSide; ++j) {
-        for (int i = 0; i <= squaresPerSide; ++i) {
-            
-            if ((j % 2) == 0) {
-                
-                ushort baseIndex = j * (squaresPerSide + 1) + i;
-                
-                indices[index + 0] = baseIndex;
-                indices[index + 1] = baseIndex + (squaresPerSide + 1);
-                
-            } else {
-                
-                ushort baseIndex = j * (squaresPerSide + 1) + (squaresPerSide - i);
-                
-                indices[index + 0] = baseIndex + (squaresPerSide + 1);
-                indices[index + 1] = baseIndex;
-                
-            }
-            
-            index += 2;
-        }
-    }
+    bodies.init(&shaders, numSquaresPerSide);
     
-    Mesh result;
+    // Home planet, with the atmosphere top where the old blended shell was
+    BodySettings home = { "Home", planetRadius, planetSeed, (float)terrainHeightMultiplier, true, -1, 0.0, 0.0, 0.0, 0.0, 9.81 };
+    int homeIndex = bodies.add(home);
     
-    result.setup(numVerts, verts, norms, cols, numIndices, indices);
+    // Periods from home's gravity
+    BodySettings moon = { "Moon", 0.25f * planetRadius, 7, 0.04, false, homeIndex, 3.8f * planetRadius, 0.0, 1.0, 0.15, 1.6 };
+    bodies.add(moon);
     
-    free(verts);
-    free(cols);
-    free(indices);
+    BodySettings smallMoon = { "Little Moon", 0.12f * planetRadius, 23, 0.06, false, homeIndex, 6.5f * planetRadius, 0.0, 2.5, -0.3, 0.6 };
+    bodies.add(smallMoon);
     
-    return result;
-}
-
-struct Model {
-    static const int maxMeshes = 64;
+    // Everything is lit by the home sky's sun
+    bodies.sunDirection = bodies.bodies[homeIndex]->atmosphere->settings.sunDirection;
     
-    int numMeshes;
-    Mesh meshes[maxMeshes];
+    // We start near home, so don't make it pop in
+    bodies.generateNow(homeIndex);
     
-    void render() {
-        for (int i = 0; i < numMeshes; ++i) {
-            meshes[i].draw();
-        }
-    }
-};
-
-Model planet;
-Model atmosphere;
-
-void setupGL() {
+    stars.init("Assets/Stars.bin", &shaders);
     
-    int numSquaresPerSide = 128;
+    RingSettings ringSettings;
+    ringSettings.planetRadius = planetRadius;
+    ringSettings.innerRadius = 1.5 * planetRadius;
+    ringSettings.outerRadius = 2.6 * planetRadius;
+    ringSettings.normal = v3(0.0, 0.0, 1.0);     // Equatorial
+    rings.build(ringSettings, &shaders);
     
-    planet.numMeshes = 6;
-//    planet.meshes[0] = buildGridMesh(numSquaresPerSide, v3(1.0, -1.0, -1.0), v3(0.0, 2.0, 0.0), v3(0.0, 0.0, 2.0));
-//    planet.meshes[1] = buildGridMesh(numSquaresPerSide, v3(-1.0, 1.0, -1.0), v3(0.0, -2.0, 0.0), v3(0.0, 0.0, 2.0));
-//    planet.meshes[2] = buildGridMesh(numSquaresPerSide, v3(1.0, 1.0, -1.0), v3(-2.0, 0.0, 0.0), v3(0.0, 0.0, 2.0));
-//    planet.meshes[3] = buildGridMesh(numSquaresPerSide, v3(-1.0, -1.0, -1.0), v3(2.0, 0.0, 0.0), v3(0.0, 0.0, 2.0));
-//    planet.meshes[4] = buildGridMesh(numSquaresPerSide, v3(-1.0, -1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, 2.0, 0.0));
-//    planet.meshes[5] = buildGridMesh(numSquaresPerSide, v3(-1.0, -1.0, -1.0), v3(2.0, 0.0, 0.0), v3(0.0, 2.0, 0.0));
-
-    planet.meshes[0] = buildGridMesh(numSquaresPerSide, v3(1.0, -1.0, 1.0), v3(0.0, 2.0, 0.0), v3(0.0, 0.0, -2.0));
-    planet.meshes[1] = buildGridMesh(numSquaresPerSide, v3(-1.0, 1.0, 1.0), v3(0.0, -2.0, 0.0), v3(0.0, 0.0, -2.0));
-    planet.meshes[2] = buildGridMesh(numSquaresPerSide, v3(1.0, 1.0, 1.0), v3(-2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0));
-    planet.meshes[3] = buildGridMesh(numSquaresPerSide, v3(-1.0, -1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0));
-    planet.meshes[4] = buildGridMesh(numSquaresPerSide, v3(-1.0, 1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, -2.0, 0.0));
-    planet.meshes[5] = buildGridMesh(numSquaresPerSide, v3(-1.0, -1.0, -1.0), v3(2.0, 0.0, 0.0), v3(0.0, 2.0, 0.0));
+    // A belt between the two moons, clear of where they'd pull it apart.
+    // Rocks are as dense as home.
+    AsteroidSettings belt;
+    belt.count = 100000;
+    belt.centre = bodies.bodies[homeIndex]->position;
+    belt.gravitationalParameter = bodyGravitationalParameter(home);
+    belt.density = belt.gravitationalParameter / (4.0 / 3.0 * M_PI * planetRadius * planetRadius * planetRadius);
+    belt.innerRadius = 4.7 * planetRadius;
+    belt.outerRadius = 5.5 * planetRadius;
+    belt.thickness = 0.02 * planetRadius;
+    belt.minSize = 2.0;
+    belt.maxSize = 60.0;
+    belt.seed = 11;
+    asteroids.init(belt, &shaders);
     
-    numSquaresPerSide = 64;
-    atmosphere.numMeshes = 6;
-    atmosphere.meshes[0] = buildAtmosphereMesh(numSquaresPerSide, v3(1.0, -1.0, 1.0), v3(0.0, 2.0, 0.0), v3(0.0, 0.0, -2.0));
-    atmosphere.meshes[1] = buildAtmosphereMesh(numSquaresPerSide, v3(-1.0, 1.0, 1.0), v3(0.0, -2.0, 0.0), v3(0.0, 0.0, -2.0));
-    atmosphere.meshes[2] = buildAtmosphereMesh(numSquaresPerSide, v3(1.0, 1.0, 1.0), v3(-2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0));
-    atmosphere.meshes[3] = buildAtmosphereMesh(numSquaresPerSide, v3(-1.0, -1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, 0.0, -2.0));
-    atmosphere.meshes[4] = buildAtmosphereMesh(numSquaresPerSide, v3(-1.0, 1.0, 1.0), v3(2.0, 0.0, 0.0), v3(0.0, -2.0, 0.0));
-    atmosphere.meshes[5] = buildAtmosphereMesh(numSquaresPerSide, v3(-1.0, -1.0, -1.0), v3(2.0, 0.0, 0.0), v3(0.0, 2.0, 0.0));
-
-
-    vertexShader = compileShader("Assets/Shaders/SimpleCameraVertex.glsl", ShaderTypeVertex);
-//    geometryShader = compileShader("Assets/Shaders/SimpleCameraGeometry.glsl", ShaderTypeGeometry);
-    fragmentShader = compileShader("Assets/Shaders/SimpleCameraFragment.glsl", ShaderTypeFragment);
+    cameraShader = shaders.load("Assets/Shaders/SimpleCameraVertex.glsl",
+//                                "Assets/Shaders/SimpleCameraGeometry.glsl",
+                                NULL,
+                                "Assets/Shaders/SimpleCameraFragment.glsl");
+    printf("Program: %u\n", shaders.program(cameraShader));
     
-    printf("Shaders: %u, %u, %u\n", vertexShader, geometryShader, fragmentShader);
+    shaders.startWatching();
     
-    shaderProgram = linkShaders(vertexShader, geometryShader, fragmentShader);
-    printf("Program: %u\n", shaderProgram);
+    frameConstants.init();
+    debugDraw.init();
     
-    glUseProgram(shaderProgram);
+    glUseProgram(shaders.program(cameraShader));
     
 }
 
@@ -322,8 +191,9 @@ void initWindowAndContext(SDL_Window **window, SDL_GLContext *context) {
     SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
+    // 3.3 for GL_INT_2_10_10_10_REV vertex attributes (packed normals)
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
     
     /* Create our window centered at 512x512 resolution */
     *window = SDL_CreateWindow(PROGRAM_NAME, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -490,6 +360,9 @@ struct InputState {
         yawRightActive = false;
         upActive = false;
         downActive = false;
+        craterRequested = false;
+        debugDrawToggled = false;
+        flightModeToggled = false;
         shouldQuit = false;
     }
     
@@ -501,6 +374,9 @@ struct InputState {
     bool yawRightActive;
     bool upActive;
     bool downActive;
+    bool craterRequested;
+    bool debugDrawToggled;
+    bool flightModeToggled;
     bool shouldQuit;
 };
 
@@ -542,6 +418,15 @@ InputState updateInputs(InputState &inputs) {
                     case SDLK_RIGHT:
                         inputs.yawRightActive = true;
                         break;
+                    case SDLK_c:
+                        inputs.craterRequested = true;
+                        break;
+                    case SDLK_g:
+                        inputs.debugDrawToggled = true;
+                        break;
+                    case SDLK_o:
+                        inputs.flightModeToggled = true;
+                        break;
                     default:
                         break;
                 }
@@ -606,6 +491,14 @@ struct Ship {
     
     PointOfView view;
     
+    double minimumAltitude;
+    
+    // Orbital flight: the throttle is thrust rather than speed, and gravity
+    // does the rest (see Orbits.cpp). Steering is the same either way.
+    bool orbital;
+    v3 orbitalVelocity;
+    double thrustMultiplier;
+    
     Ship(const PointOfView &_view) {
         
         view = _view;
@@ -625,9 +518,34 @@ struct Ship {
         acceleration = 0.1;
         velocity = 0.0;
         velocityMultiplier = 1000.0;
+        
+        minimumAltitude = 2.0;
+        
+        orbital = false;
+        orbitalVelocity = v3(0.0f, 0.0f, 0.0f);
+        thrustMultiplier = 0.1;
+    }
+    
+    v3 currentVelocity() {
+        if (orbital) {
+            return orbitalVelocity;
+        }
+        return (float)(velocity * velocityMultiplier) * v3normalize(view.direction);
     }
     
-    void moveShip(const InputState &inputs, double dt, v3 planetPos, double planetRad) {
+    // Carries on at the same velocity in the other mode
+    void toggleFlightMode() {
+        if (!orbital) {
+            orbitalVelocity = currentVelocity();
+            velocity = 0.0;
+        }
+        orbital = !orbital;
+    }
+    
+    // `groundRadius` is the distance from the planet centre to the terrain
+    // below the ship, `planetVelocity` how fast that planet is moving
+    void moveShip(const InputState &inputs, double dt, v3 planetPos, v3 planetVelocity, double groundRadius,
+                  const GravitySources &gravity) {
         
         if (inputs.leftActive) {
             rollVelocity -= rollAcceleration * dt;
@@ -709,121 +627,604 @@ struct Ship {
         view.pitch(pitchVelocity * pitchMultiplier);
         view.yaw(yawVelocity * yawMultiplier);
         
-        velocityMultiplier = v3length(view.position - planetPos) - planetRad;
+        velocityMultiplier = v3length(view.position - planetPos) - groundRadius;
         
         if (velocityMultiplier < 10.0) {
             velocityMultiplier = 10.0;
         }
         
-        view.move(velocity * dt * velocityMultiplier);
+        if (orbital) {
+            v3 thrust = (float)(velocity * thrustMultiplier * velocityMultiplier) * v3normalize(view.direction);
+            leapfrogStep(view.position, orbitalVelocity, thrust, gravity, dt);
+        } else {
+            view.move(velocity * dt * velocityMultiplier);
+        }
+        
+        // Don't fly into the ground
+        v3 offset = view.position - planetPos;
+        double minRadius = groundRadius + minimumAltitude;
+        
+        if (v3length(offset) < minRadius) {
+            v3 up = v3normalize(offset);
+            view.position = planetPos + minRadius * up;
+            
+            // Landed: lose whatever was heading into the ground
+            v3 relative = orbitalVelocity - planetVelocity;
+            float down = v3dot(relative, up);
+            if (down < 0.0) {
+                orbitalVelocity = orbitalVelocity - down * up;
+            }
+        }
     }
 };
 
-void runMainLoop(SDL_Window *window) {
-    
-    setupGL();
-    
-    double t = 0.0;
-    const double dt = 1.0 / 60.0;
-    
-    double currentTime = timer.seconds();
-    double accumulator = 0.0;
+// Camera lens, shared by culling (simulation side) and the projection
+const float fieldOfView = 45.0;
+const float aspectRatio = 4.0 / 3.0;
+const float nearPlane = 10.0;
+const float farPlane = 50000.0;
+
+// The ship's path around whichever body is nearest
+struct ShipOrbit {
+    bool orbital;
+    int body;
+    float altitude;
+    float speed;                // Relative to the body
+    OrbitShape shape;           // Altitudes, not radii
+};
+
+// Running totals, the renderer reports the change since the last snapshot it drew
+struct SimulationTotals {
+    long ticks;
+    double updateTime;
+    double clampedTime;         // Cut off long frames by maxFrameTime
+    double backlogTime;         // Ticks left over when tickLimit ran out
+    double asteroidTime;
+    
+    SimulationTotals() {
+        ticks = 0;
+        updateTime = 0.0;
+        clampedTime = 0.0;
+        backlogTime = 0.0;
+        asteroidTime = 0.0;
+    }
+};
 
+// Everything the renderer needs from the simulation. Once published it
+// isn't touched again until the simulation gets the slot back.
+struct FrameSnapshot {
     PointOfView view;
+    v3 planetPos;               // Home planet
+    double time;
+    bool debugDrawEnabled;
     
-    v3 from(5.0, 0.0, 0.2);
-    v3 dir(-from.x, -from.y, -from.z);
-    v3 up(0.0, 0.0, 1.0);
+    // Bodies in view, from the one culling pass, and what the occlusion
+    // pass took out of their terrain
+    int numBodyViews;
+    BodyView bodyViews[Bodies::maxBodies];
+    OcclusionStats occlusion;
     
-    from = planetRadius * from;
-    view.position = from;
-    view.direction = dir;
-    view.updateForUpVector(up);
-
-    Ship ship(view);
+    // Asteroids in view, by level of detail
+    AsteroidDrawList asteroids;
+    AsteroidGravityStats asteroidGravity;
+    
+    ShipOrbit shipOrbit;
     
+    SimulationTotals totals;
+};
+
+// Held keys are the latest posted, one-shot requests are kept until taken
+// (two debug draw toggles in between cancel out)
+struct InputMailbox {
+    std::mutex lock;
     InputState inputs;
     
-    // Basic run loop from http://gafferongames.com/game-physics/fix-your-timestep/
-    // TODO: (George) Final interpolation between states for super smoothness
+    void post(const InputState &latest) {
+        std::lock_guard<std::mutex> guard(lock);
+        
+        bool craterRequested = inputs.craterRequested || latest.craterRequested;
+        bool debugDrawToggled = inputs.debugDrawToggled != latest.debugDrawToggled;
+        bool flightModeToggled = inputs.flightModeToggled != latest.flightModeToggled;
+        
+        inputs = latest;
+        inputs.craterRequested = craterRequested;
+        inputs.debugDrawToggled = debugDrawToggled;
+        inputs.flightModeToggled = flightModeToggled;
+    }
     
-    while (!inputs.shouldQuit)
-    {
-        double newTime = timer.seconds();
-        double frameTime = newTime - currentTime;
-        currentTime = newTime;
+    InputState take() {
+        std::lock_guard<std::mutex> guard(lock);
         
-        // GATHER USER INPUT (PLUS NETWORK INPUT?) - START
-        inputs = updateInputs(inputs);
+        InputState taken = inputs;
+        inputs.craterRequested = false;
+        inputs.debugDrawToggled = false;
+        inputs.flightModeToggled = false;
         
-        // GATHER USER INPUT (PLUS NETWORK INPUT?) - END
+        return taken;
+    }
+};
+
+struct Simulation {
+    double t;
+    double dt;
+    double accumulator;
+    
+    // Spiral-of-death protection. After a long stall we only catch up a few
+    // ticks per frame and throw the rest of the backlog away (the simulation
+    // runs slow for a moment rather than grinding to a halt).
+    int maxTicksPerFrame;
+    double maxFrameTime;
+    double updateBudget;
+    double averageTickCost;
+    
+    Ship ship;
+    bool debugDrawEnabled;
+    
+    // For sizing bodies on screen when culling
+    float screenHeight;
+    
+    SimulationTotals totals;
+    
+    // Craters waiting for the renderer (the edits upload vertices)
+    struct PendingCrater {
+        int body;
+        v3 centre;              // Body-local
+    };
+    std::mutex editLock;
+    std::vector<PendingCrater> pendingCraters;
+    
+    Simulation(const PointOfView &view, float _screenHeight) : ship(view) {
+        t = 0.0;
+        dt = 1.0 / 60.0;
+        accumulator = 0.0;
+        
+        maxTicksPerFrame = 8;
+        maxFrameTime = 0.25;
+        updateBudget = 0.5 * dt;
+        averageTickCost = 0.0;
+        
+        debugDrawEnabled = false;
+        screenHeight = _screenHeight;
+        
+        bodies.update(t);
+    }
+    
+    // Runs however many fixed steps `frameTime` of real time is worth
+    void advance(const InputState &inputs, double frameTime) {
+        double clampedTime = 0.0;
+        double backlogTime = 0.0;
         
-        accumulator += frameTime;
+        if (frameTime > maxFrameTime) {
+            clampedTime = frameTime - maxFrameTime;
+            accumulator += maxFrameTime;
+        } else {
+            accumulator += frameTime;
+        }
         
-        while ( accumulator >= dt )
+        // Only take on as many ticks as we can afford, based on what they've been costing
+        int tickLimit = maxTicksPerFrame;
+        if (averageTickCost > 0.0 && averageTickCost * tickLimit > updateBudget) {
+            tickLimit = (int)(updateBudget / averageTickCost);
+            if (tickLimit < 1) {
+                tickLimit = 1;
+            }
+        }
+        
+        int ticks = 0;
+        double updateStart = timer.seconds();
+        
+        while ( accumulator >= dt && ticks < tickLimit )
         {
+            double tickStart = timer.seconds();
             
             // GAME STATE UPDATE - START
             //            integrate( state, t, dt );
             
-            ship.moveShip(inputs, dt, v3(0.0, 0.0, 0.0), planetRadius);
+            bodies.update(t);
+            
+            GravitySources gravity;
+            bodies.gravitySources(gravity);
+            
+            // Keep off whichever body is closest
+            int nearest = bodies.nearest(ship.view.position);
+            v3 bodyPos = bodies.bodies[nearest]->position;
+            v3 bodyVelocity = bodies.bodies[nearest]->velocity;
+            
+            double groundRadius;
+            {
+                std::lock_guard<std::mutex> guard(bodies.lock);
+                groundRadius = bodies.bodies[nearest]->terrain.surfaceRadiusAt(ship.view.position - bodyPos);
+            }
+            
+            ship.moveShip(inputs, dt, bodyPos, bodyVelocity, groundRadius, gravity);
+            
+            double asteroidStart = timer.seconds();
+            asteroids.step(dt, gravity);
+            totals.asteroidTime += timer.seconds() - asteroidStart;
             
             // GAME STATE UPDATE - END
             
+            double tickCost = timer.seconds() - tickStart;
+            if (averageTickCost == 0.0) {
+                averageTickCost = tickCost;
+            } else {
+                averageTickCost = 0.9 * averageTickCost + 0.1 * tickCost;
+            }
+            
             accumulator -= dt;
             t += dt;
+            ticks += 1;
         }
         
-        // GAME STATE RENDER - START
-
+        // Anything we couldn't get through this frame is dropped, not carried forward
+        if (accumulator >= dt) {
+            backlogTime = dt * floor(accumulator / dt);
+            accumulator -= backlogTime;
+        }
         
-        glClearColor ( 0.05, 0.0, 0.1, 1.0 );
-        glClear ( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+        if (inputs.craterRequested) {
+            // Dig a crater in the nearest body where the ship is looking, or
+            // straight below it if that's sky
+            PendingCrater crater;
+            crater.body = bodies.nearest(ship.view.position);
+            
+            Body *body = bodies.bodies[crater.body];
+            v3 localPos = ship.view.position - body->position;
+            
+            crater.centre = localPos;
+            {
+                std::lock_guard<std::mutex> guard(bodies.lock);
+                body->terrain.raycastTerrain(localPos, ship.view.direction, 4.0 * body->settings.radius, crater.centre);
+            }
+            
+            std::lock_guard<std::mutex> guard(editLock);
+            pendingCraters.push_back(crater);
+        }
         
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LESS);
-        CHECK_GL_ERRORS();
+        if (inputs.debugDrawToggled) {
+            debugDrawEnabled = !debugDrawEnabled;
+        }
         
-        Mat4x4 projectionMatrix;
-        Mat4x4 viewMatrix;
+        if (inputs.flightModeToggled) {
+            ship.toggleFlightMode();
+            printf("Flight: %s\n", ship.orbital ? "orbital" : "arcade");
+        }
+        
+        totals.ticks += ticks;
+        totals.updateTime += timer.seconds() - updateStart;
+        totals.clampedTime += clampedTime;
+        totals.backlogTime += backlogTime;
+    }
+    
+    void snapshot(FrameSnapshot &frame) {
+        frame.view = ship.view;
+        frame.planetPos = bodies.bodies[0]->position;
+        frame.time = t;
+        frame.debugDrawEnabled = debugDrawEnabled;
+        
+        {
+            std::lock_guard<std::mutex> guard(bodies.lock);
+            frame.numBodyViews = bodies.cull(ship.view.position, ship.view.direction, fieldOfView, aspectRatio,
+                                             screenHeight, frame.bodyViews);
+            
+            OcclusionCamera camera;
+            camera.setup(ship.view.position, ship.view.direction, ship.view.right, ship.view.up,
+                         fieldOfView, aspectRatio, nearPlane);
+            frame.occlusion = bodies.occlusionCull(camera, frame.bodyViews, frame.numBodyViews);
+        }
+        
+        asteroids.gather(ship.view.position, ship.view.direction, fieldOfView, aspectRatio, screenHeight,
+                         frame.asteroids);
+        frame.asteroidGravity = asteroids.gravityStats;
+        
+        int nearestIndex = bodies.nearest(ship.view.position);
+        Body *nearest = bodies.bodies[nearestIndex];
+        v3 relativePosition = ship.view.position - nearest->position;
+        v3 relativeVelocity = ship.currentVelocity() - nearest->velocity;
+        
+        ShipOrbit &orbit = frame.shipOrbit;
+        orbit.orbital = ship.orbital;
+        orbit.body = nearestIndex;
+        orbit.altitude = v3length(relativePosition) - nearest->settings.radius;
+        orbit.speed = v3length(relativeVelocity);
+        orbit.shape = osculatingOrbit(relativePosition, relativeVelocity, bodyGravitationalParameter(nearest->settings));
+        orbit.shape.periapsis -= nearest->settings.radius;
+        if (orbit.shape.apoapsis >= 0.0) {
+            orbit.shape.apoapsis -= nearest->settings.radius;
+        }
+        
+        frame.totals = totals;
+    }
+    
+    // Render thread only
+    void applyEdits() {
+        std::vector<PendingCrater> craters;
+        {
+            std::lock_guard<std::mutex> guard(editLock);
+            craters.swap(pendingCraters);
+        }
         
-        buildProjectionMatrix(projectionMatrix, 45.0, 4.0 / 3.0, 10.0, 50000.0);
+        for (size_t i = 0; i < craters.size(); ++i) {
+            std::lock_guard<std::mutex> guard(bodies.lock);
+            int changed = bodies.bodies[craters[i].body]->terrain.crater(craters[i].centre, 0.01, 0.4);
+            printf("Crater: %d vertices changed on %s\n", changed, bodies.bodies[craters[i].body]->settings.name);
+        }
+    }
+};
+
+// Simulation thread for the pipelined mode: steps the simulation as real time
+// passes and publishes a snapshot after each batch of ticks
+void simulationLoop(Simulation *simulation, InputMailbox *mailbox,
+                    TripleBuffer<FrameSnapshot> *snapshots, std::atomic<bool> *running) {
+    
+    // Own job deque and stats, rather than the render thread's
+    jobs.registerExternalThread();
+    
+    double currentTime = timer.seconds();
+    
+    while (*running) {
+        double newTime = timer.seconds();
+        double frameTime = newTime - currentTime;
+        currentTime = newTime;
         
-        ship.view.getCameraMatrix(viewMatrix);
+        simulation->advance(mailbox->take(), frameTime);
         
-        multMatrix(projectionMatrix, viewMatrix);
+        simulation->snapshot(snapshots->writeSlot());
+        snapshots->publish();
         
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "mvpmatrix"), 1, GL_FALSE, projectionMatrix);
-        CHECK_GL_ERRORS();
+        // Nothing to do until the next tick is due
+        double wait = simulation->dt - simulation->accumulator - (timer.seconds() - newTime);
+        if (wait > 0.0) {
+            std::this_thread::sleep_for(std::chrono::microseconds((long)(wait * 1000000.0)));
+        }
+    }
+}
 
+void renderFrame(SDL_Window *window, const FrameSnapshot &frame, long screenSamples) {
+    
+    shaders.update();
+    GLuint shaderProgram = shaders.program(cameraShader);
+    
+    glClearColor ( 0.05, 0.0, 0.1, 1.0 );
+    glClear ( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    CHECK_GL_ERRORS();
+    
+    PointOfView view = frame.view;
+    
+    FrameConstants constants;
+    
+    buildProjectionMatrix(constants.projectionMatrix, fieldOfView, aspectRatio, nearPlane, farPlane);
+    
+    view.getCameraMatrix(constants.viewMatrix);
+    
+    memcpy(constants.viewProjectionMatrix, constants.projectionMatrix, sizeof(Mat4x4));
+    multMatrix(constants.viewProjectionMatrix, constants.viewMatrix);
+    
+    constants.cameraPosition[0] = view.position.x;
+    constants.cameraPosition[1] = view.position.y;
+    constants.cameraPosition[2] = view.position.z;
+    constants.cameraPosition[3] = 1.0;
+    constants.time = frame.time;
+    
+    // One upload per frame, seen by every program through the FrameConstants block
+    frameConstants.update(constants);
+    
+    stars.draw(view.direction, fieldOfView, aspectRatio);
+    
+    glUseProgram(shaderProgram);
+    CHECK_GL_ERRORS();
+    
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    bodies.draw(frame.bodyViews, frame.numBodyViews, view.position);
+    
+    asteroids.draw(frame.asteroids, bodies.sunDirection);
+    
+    rings.draw(frame.planetPos, bodies.sunDirection);
+    
+    if (frame.debugDrawEnabled) {
+        debugDraw.begin();
+        
+        // Cube face edges, lifted a little off the sea
+        const v4 edgeColor(1.0, 1.0, 0.0, 1.0);
+        for (int i = 0; i < 8; ++i) {
+            v3 corner((i & 1) ? 1.0 : -1.0, (i & 2) ? 1.0 : -1.0, (i & 4) ? 1.0 : -1.0);
+            for (int axis = 1; axis < 8; axis <<= 1) {
+                if ((i & axis) == 0) {
+                    v3 other((i | axis) & 1 ? 1.0 : -1.0, (i | axis) & 2 ? 1.0 : -1.0, (i | axis) & 4 ? 1.0 : -1.0);
+                    debugDraw.arc(corner, other, planetRadius * 1.01, 32, edgeColor);
+                }
+            }
+        }
+        
+        // Planet axis and the line straight down from the ship
+        debugDraw.line(v3(0.0, 0.0, -1.5 * planetRadius), v3(0.0, 0.0, 1.5 * planetRadius), v4(1.0, 1.0, 1.0, 1.0));
+        debugDraw.line(view.position, planetRadius * v3normalize(view.position), v4(1.0, 0.2, 0.2, 1.0));
+        
+        glDisable(GL_BLEND);
         glUseProgram(shaderProgram);
-        CHECK_GL_ERRORS();
+        debugDraw.draw();
+    }
+    
+    SDL_GL_SwapWindow(window);
+    CHECK_GL_ERRORS();
+    
+    // Over budget? Drop whatever hasn't been drawn for longest
+    meshCache.enforceBudget();
+    gpuMemory.frame += 1;
+    
+    frameStats.recordGpuMemory(gpuMemory.total, gpuMemory.peak, gpuMemory.budget,
+                               gpuMemory.evictions, gpuMemory.restores, gpuMemory.evictedBytes);
+    gpuMemory.evictions = 0;
+    gpuMemory.restores = 0;
+    gpuMemory.evictedBytes = 0;
+    
+    frameStats.recordStream(debugDraw.stream.bytesWritten, debugDraw.stream.fenceStalls, debugDraw.stream.overflows);
+    debugDraw.stream.bytesWritten = 0;
+    debugDraw.stream.fenceStalls = 0;
+    debugDraw.stream.overflows = 0;
+    
+    frameStats.recordStream(asteroids.instanceStream.bytesWritten, asteroids.instanceStream.fenceStalls,
+                            asteroids.instanceStream.overflows);
+    asteroids.instanceStream.bytesWritten = 0;
+    asteroids.instanceStream.fenceStalls = 0;
+    asteroids.instanceStream.overflows = 0;
+    
+    for (int i = 0; i < jobs.numSlots(); ++i) {
+        frameStats.recordJobs(i, jobs.busyMicroseconds[i].exchange(0), jobs.jobsRun[i].exchange(0), jobs.steals[i].exchange(0));
+    }
+    
+    bodies.recordStats(screenSamples);
+    
+    frameStats.recordStars(stars.starsDrawn, stars.cellsDrawn, stars.drawnLimit);
+    stars.starsDrawn = 0;
+    stars.cellsDrawn = 0;
+    
+    frameStats.recordAsteroidsDrawn(asteroids.instancesDrawn[0], asteroids.instancesDrawn[1], asteroids.instancesDrawn[2],
+                                    asteroids.instancesDropped);
+    for (int i = 0; i < AsteroidField::numLevels; ++i) {
+        asteroids.instancesDrawn[i] = 0;
+    }
+    asteroids.instancesDropped = 0;
+    
+    debugDraw.endFrame();
+    asteroids.endFrame();
+}
 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+// `pipelined` runs the simulation on its own thread, so a frame costs
+// max(update, render) rather than update + render. SDL events and GL stay
+// on this (the main) thread either way.
+void runMainLoop(SDL_Window *window, bool pipelined, bool report) {
+    
+    setupGL(report);
+    
+    // For turning samples passed into overdraw (multisampled, so it's per sample)
+    GLint viewport[4];
+    GLint multisamples = 0;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_SAMPLES, &multisamples);
+    long screenSamples = (long)viewport[2] * viewport[3] * (multisamples > 1 ? multisamples : 1);
+    
+    double currentTime = timer.seconds();
+    
+    frameStats.reset(currentTime);
+    jobs.resetStats();
 
-        glDisable(GL_BLEND);
-        glEnable(GL_DEPTH_TEST);
-        planet.render();
+    PointOfView view;
+    
+    v3 from(5.0, 0.0, 0.2);
+    v3 dir(-from.x, -from.y, -from.z);
+    v3 up(0.0, 0.0, 1.0);
+    
+    from = planetRadius * from;
+    view.position = from;
+    view.direction = dir;
+    view.updateForUpVector(up);
 
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_BLEND);
+    Simulation simulation(view, viewport[3]);
+    
+    InputState inputs;
+    InputMailbox mailbox;
+    
+    // Latest simulation state, handed over without either side waiting on the other
+    TripleBuffer<FrameSnapshot> *snapshots = new TripleBuffer<FrameSnapshot>();
+    simulation.snapshot(snapshots->writeSlot());
+    snapshots->publish();
+    snapshots->acquire();
+    
+    SimulationTotals reported = snapshots->readSlot().totals;
+    
+    std::atomic<bool> simulationRunning(pipelined);
+    std::thread simulationThread;
+    
+    if (pipelined) {
+        simulationThread = std::thread(simulationLoop, &simulation, &mailbox, snapshots, &simulationRunning);
+    }
+    
+    printf("Simulation: %s\n", pipelined ? "pipelined" : "serial");
+    
+    // Basic run loop from http://gafferongames.com/game-physics/fix-your-timestep/
+    // TODO: (George) Final interpolation between states for super smoothness
+    
+    while (!inputs.shouldQuit)
+    {
+        double newTime = timer.seconds();
+        double frameTime = newTime - currentTime;
+        currentTime = newTime;
+        
+        // GATHER USER INPUT (PLUS NETWORK INPUT?) - START
+        inputs = updateInputs(inputs);
+        mailbox.post(inputs);
+        inputs.craterRequested = false;
+        inputs.debugDrawToggled = false;
+        inputs.flightModeToggled = false;
         
-        glCullFace(GL_FRONT);
-        atmosphere.render();
+        // GATHER USER INPUT (PLUS NETWORK INPUT?) - END
         
-        // TODO: (George) Only if we're outside the atmosphere...
-        glCullFace(GL_BACK);
-        atmosphere.render();
+        if (!pipelined) {
+            simulation.advance(mailbox.take(), frameTime);
+            simulation.snapshot(snapshots->writeSlot());
+            snapshots->publish();
+        }
         
-        SDL_GL_SwapWindow(window);
-        CHECK_GL_ERRORS();
+        // If the simulation hasn't produced anything new we draw the last state again
+        snapshots->acquire();
+        const FrameSnapshot &frame = snapshots->readSlot();
+        
+        frameStats.recordSimulation((int)(frame.totals.ticks - reported.ticks), simulation.dt, frameTime,
+                                    frame.totals.updateTime - reported.updateTime,
+                                    frame.totals.clampedTime - reported.clampedTime,
+                                    frame.totals.backlogTime - reported.backlogTime);
+        frameStats.recordAsteroidSteps(asteroids.count, frame.totals.asteroidTime - reported.asteroidTime,
+                                       asteroids.stepBudget);
+        frameStats.recordAsteroidGravity(frame.asteroidGravity.treeNodes, frame.asteroidGravity.treeBuildTime,
+                                         frame.asteroidGravity.treeBuildTicks, frame.asteroidGravity.refreshSlice,
+                                         frame.asteroidGravity.sweepTime);
+        frameStats.recordOcclusion(frame.occlusion.occluderTriangles, frame.occlusion.chunksTested,
+                                   frame.occlusion.chunksOccluded, frame.occlusion.chunksOutside, frame.occlusion.time);
+        
+        const ShipOrbit &orbit = frame.shipOrbit;
+        frameStats.recordShip(orbit.orbital, bodies.bodies[orbit.body]->settings.name, orbit.altitude, orbit.speed,
+                              orbit.shape.periapsis, orbit.shape.apoapsis);
+        reported = frame.totals;
+        
+        // GAME STATE RENDER - START
+        
+        simulation.applyEdits();
+        
+        renderFrame(window, frame, screenSamples);
         
         // GAME STATE RENDER - END
+        
+        frameStats.report(timer.seconds());
     }
+    
+    if (pipelined) {
+        simulationRunning = false;
+        simulationThread.join();
+    }
+    delete snapshots;
 
+    // Before the job system goes, in case a body or gravity tree is still being built
+    bodies.destroy();
+    asteroids.destroy();
+    
+    jobs.shutdown();
+    
     // Clean up GL
     glUseProgram(0);
+    shaders.destroy();
+    frameConstants.destroy();
+    debugDraw.destroy();
+    
+    stars.destroy();
+    rings.destroy();
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
     
@@ -835,8 +1236,20 @@ int main(int argc, char *argv[])
     SDL_Window *mainWindow; /* Our window handle */
     SDL_GLContext mainContext; /* Our opengl context handle */
 
+    // --pipelined runs the simulation on its own thread, --report measures
+    // and prints what the startup numbers are based on
+    bool pipelined = false;
+    bool report = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--pipelined") == 0) {
+            pipelined = true;
+        } else if (strcmp(argv[i], "--report") == 0) {
+            report = true;
+        }
+    }
+
     initWindowAndContext(&mainWindow, &mainContext);
-    runMainLoop(mainWindow);
+    runMainLoop(mainWindow, pipelined, report);
     deleteWindowAndContext(mainWindow, mainContext);
 
     SDL_Quit();